@@ -1,4 +1,4 @@
-import React, { createContext, useContext, useEffect, useState } from 'react'
+import React, { createContext, useContext, useEffect, useRef, useState } from 'react'
 import axios from 'axios'
 import { isEqual, toMoveString, toBoard } from '../utils.js'
 
@@ -22,6 +22,8 @@ const ChessProvider = (props) => {
   const [side, setSide] = useState('w')
   const [game, setGame] = useState('')
   const [gameOver, setGameOver] = useState('No')
+  const [gameId, setGameId] = useState('')
+  const gameIdRef = useRef('')
 
   const playSound = (name) => {
     const audio = new Audio(`${name}.mp3`)
@@ -67,8 +69,16 @@ const ChessProvider = (props) => {
     setPositionTo(position)
   }
 
+  const newGame = () => {
+    setGameId('')
+    axios.get(`${serverUrl}/reset?id=${gameIdRef.current}`).then(res => {
+      gameIdRef.current = res.data.id
+      setGameId(res.data.id)
+    })
+  }
+
   const rematch = () => {
-    axios.get(`${serverUrl}/reset`)
+    newGame()
 
     setGame(game === 'w' ? 'b' : 'w')
     setBoard(startingPositions)
@@ -99,13 +109,13 @@ const ChessProvider = (props) => {
   }, [game])
 
   useEffect(() => {
-    axios.get(`${serverUrl}/reset`)
+    newGame()
   }, [])
 
   useEffect(() => {
     // player move
     if (!positionFrom.length || !positionTo.length) return
-    axios.get(`${serverUrl}/make_move?move=${toMoveString(positionFrom, positionTo)}`)
+    axios.get(`${serverUrl}/make_move?id=${gameId}&move=${toMoveString(positionFrom, positionTo)}`)
       .then(res => {
         const isCheck = res.data.isCheck
         const isCapture = board[positionTo[0]][positionTo[1]] !== null
@@ -123,7 +133,8 @@ const ChessProvider = (props) => {
   }, [positionFrom, positionTo])
 
   useEffect(() => {
-    axios.get(`${serverUrl}/game`).then(res => {
+    if (!gameId) return
+    axios.get(`${serverUrl}/game?id=${gameId}`).then(res => {
       if (res.data.gameState === 'checkmate') {
         setGameOver('Checkmate')
         playSound('checkmate')
@@ -136,7 +147,7 @@ const ChessProvider = (props) => {
     if (gameOver !== 'No') return
     if (side === game || !game) return
 
-    axios.get(`${serverUrl}/genmove`).then(res => {
+    axios.get(`${serverUrl}/genmove?id=${gameId}`).then(res => {
       const bestMoveSplit = res.data.move.split('')
       const to = [8 - parseInt(bestMoveSplit[3]), bestMoveSplit[2].charCodeAt(0) - 'a'.charCodeAt(0)]
 
@@ -151,7 +162,7 @@ const ChessProvider = (props) => {
     }).catch((err) => {
       console.error(err)
     })
-  }, [board, game])
+  }, [board, game, gameId])
 
   return (
         <ChessContext.Provider value={{
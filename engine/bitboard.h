@@ -27,8 +27,8 @@ template <typename T> class BitIterator {
 
 class Bitboard {
   public:
-    Bitboard() : bitboard_(0) {}
-    Bitboard(uint64_t board) : bitboard_(board) {}
+    constexpr Bitboard() : bitboard_(0) {}
+    constexpr Bitboard(uint64_t board) : bitboard_(board) {}
 
     // check if the ith bit is set
     inline bool get(Square i) const { return get(i.square_); }
@@ -1,54 +1,26 @@
 #include "chessboard.h"
 #include "bitboard.h"
+#include "evaluate.h"
+#include "log.h"
 #include "move.h"
 #include "move_generator.h"
-#include "random.h"
 #include <algorithm>
+#include <cassert>
 #include <sstream>
 #include <string>
 
-uint64_t PieceKeys[2][6][64] = {0};
-uint64_t CastleKeys[4] = {0};
-uint64_t EnPassantKeys[8] = {0};
-uint64_t whiteToMoveKey = 0;
-
-// generate key for position hash
-void init_keys() {
-    for (int i = 0; i < 8; i++) {
-        EnPassantKeys[i] = randInt64();
-    }
-    for (int i = 0; i < 4; i++) {
-        CastleKeys[i] = randInt64();
-    }
-    for (int i = 0; i < 2; i++) {
-        for (int j = 0; j < 6; j++) {
-            for (int k = 0; k < 64; k++) {
-                PieceKeys[i][j][k] = randInt64();
-            }
-        }
-    }
-    whiteToMoveKey = randInt64();
-}
+// castling rights kept when a piece moves from or to each square
+const int castling_rights_masks[64] = {
+    13, 15, 15, 15, 12, 15, 15, 14, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 7,  15, 15, 15, 3,  15, 15, 11};
 
 std::string ChessBoard::to_string() const {
     std::string board;
 
     for (int i = 0; i < 64; i++) {
-        if (pawns_.get(i)) {
-            board += 'p';
-        } else if (knights_.get(i)) {
-            board += 'n';
-        } else if (bishops_.get(i)) {
-            board += 'b';
-        } else if (rooks_.get(i)) {
-            board += 'r';
-        } else if (queens_.get(i)) {
-            board += 'q';
-        } else if (kings_.get(i)) {
-            board += 'k';
-        } else {
-            board += '.';
-        }
+        board += ".pnbrqk"[piece_on_[i] == NoPiece ? 0 : piece_on_[i] + 1];
         if (white_pieces_.get(i)) {
             // convert last char to uppercase
             board.back() -= 32;
@@ -74,76 +46,227 @@ std::string ChessBoard::to_string() const {
 }
 
 bool ChessBoard::act(Move move, bool update) {
-    Square from = move.from_;
-    Square to = move.to_;
-    char promotion = move.promotion_;
-
-    update_draw_condition(from, to);
-    check_en_passant(from, to);
-    check_promotion(promotion, from);
-    castling(from, to);
-    pawns_.update(from, to);
-    knights_.update(from, to);
-    bishops_.update(from, to);
-    rooks_.update(from, to);
-    queens_.update(from, to);
-    kings_.update(from, to);
-    white_pieces_.update(from, to);
-    black_pieces_.update(from, to);
-    all_pieces_.update(from, to);
-
-    position_hash_history_.push_back(generate_hash());
-    player_ = (player_ == Player::White) ? Player::Black : Player::White;
+    make_move(move);
 
     if (update) {
         update_game_state();
-        std::cout << to_string() << std::endl;
+        if (log_enabled(LogLevel::Debug)) {
+            std::string board = to_string();
+            board.erase(board.find_last_not_of('\n') + 1);
+            log_message(LogLevel::Debug,
+                        "after " + move.to_string() + "\n" + board);
+        }
     }
-    fullmove_number_++;
 
     return true;
 }
 
-void ChessBoard::check_en_passant(Square from, Square to) {
-    // check if en passant is played
-    if (pawns_.get(from) && en_passant_.get(to)) {
-        // clear captured pawn
-        if (white_pieces_.get(from)) {
-            pawns_.clear(to.square_ - 8);
-            black_pieces_.clear(to.square_ - 8);
-            all_pieces_.clear(to.square_ - 8);
-        } else if (black_pieces_.get(from)) {
-            pawns_.clear(to.square_ + 8);
-            white_pieces_.clear(to.square_ + 8);
-            all_pieces_.clear(to.square_ + 8);
-        }
+void ChessBoard::make_move(Move move) {
+    int from = move.from();
+    int to = move.to();
+    PieceType moved = piece_on_[from];
+
+    UndoState state;
+    state.move = move;
+    state.captured = piece_on_[to];
+    state.castling_rights = castling_rights_;
+    state.en_passant = en_passant_.empty() ? -1 : en_passant_.getLSB();
+    state.fifty_move_rule = fifty_move_rule_;
+    state.hash = hash_;
+
+    int color = player_ == Player::White ? 0 : 1;
+    fifty_move_rule_++;
+
+    size_t ply = undo_stack_.size() + 1;
+    if (accumulators_.size() <= ply) {
+        accumulators_.resize(ply + 1);
     }
-    en_passant_.reset();
-    // check for double pawn moves
-    if (pawns_.get(from) && (abs(from.rank_ - to.rank_) == 2)) {
-        en_passant_.set((from.square_ + to.square_) / 2);
+    NnueAccumulator &accumulator = accumulators_[ply];
+    accumulator.computed[0] = accumulator.computed[1] = false;
+    accumulator.dirty_count = 0;
+
+    if (state.captured != NoPiece) {
+        hash_ ^= PieceKeys[color ^ 1][state.captured][to];
+        remove_piece(color ^ 1, state.captured, to);
+        accumulator.add_dirty(color ^ 1, state.captured, to, -1);
+        fifty_move_rule_ = 0;
     }
-}
 
-void ChessBoard::check_promotion(char promotion, Square from) {
-    if (promotion) {
-        switch (promotion) {
+    if (moved == Pawn) {
+        fifty_move_rule_ = 0;
+        // clear pawn captured en passant
+        if (en_passant_.get(to)) {
+            int captured = player_ == Player::White ? to - 8 : to + 8;
+            hash_ ^= PieceKeys[color ^ 1][Pawn][captured];
+            remove_piece(color ^ 1, Pawn, captured);
+            accumulator.add_dirty(color ^ 1, Pawn, captured, -1);
+            state.captured = Pawn;
+        }
+    }
+
+    hash_ ^= PieceKeys[color][moved][from] ^ PieceKeys[color][moved][to];
+    move_piece(color, moved, from, to);
+    accumulator.add_dirty(color, moved, from, to);
+
+    if (move.promotion()) {
+        PieceType promoted = Queen;
+        switch (move.promotion()) {
         case 'q':
-            queens_.set(from);
+            promoted = Queen;
             break;
         case 'r':
-            rooks_.set(from);
+            promoted = Rook;
             break;
         case 'b':
-            bishops_.set(from);
+            promoted = Bishop;
             break;
         case 'n':
-            knights_.set(from);
+            promoted = Knight;
             break;
         default:
-            std::cerr << "invalid promotion piece" << std::endl;
+            log_message(LogLevel::Warning, "invalid promotion piece");
+        }
+        hash_ ^= PieceKeys[color][Pawn][to] ^ PieceKeys[color][promoted][to];
+        remove_piece(color, Pawn, to);
+        put_piece(color, promoted, to);
+        accumulator.add_dirty(color, Pawn, to, -1);
+        accumulator.add_dirty(color, promoted, -1, to);
+    }
+
+    // move rook if castling
+    if (moved == King && abs(from - to) == 2) {
+        int rook_from = to > from ? from + 3 : from - 4;
+        int rook_to = (from + to) / 2;
+        hash_ ^= PieceKeys[color][Rook][rook_from] ^
+                 PieceKeys[color][Rook][rook_to];
+        move_piece(color, Rook, rook_from, rook_to);
+        accumulator.add_dirty(color, Rook, rook_from, rook_to);
+    }
+
+    // remove castling rights if king or rook is moved or captured
+    castling_rights_ &= castling_rights_masks[from] & castling_rights_masks[to];
+    for (int i = 0; i < 4; i++) {
+        if ((castling_rights_ ^ state.castling_rights) & (1 << i)) {
+            hash_ ^= CastleKeys[i];
         }
-        pawns_.clear(from);
+    }
+
+    if (state.en_passant >= 0) {
+        hash_ ^= EnPassantKeys[state.en_passant % 8];
+    }
+    en_passant_.reset();
+    if (moved == Pawn && abs(from - to) == 16) {
+        en_passant_.set((from + to) / 2);
+        hash_ ^= EnPassantKeys[from % 8];
+    }
+
+    if (player_ == Player::Black) {
+        fullmove_number_++;
+    }
+    player_ = (player_ == Player::White) ? Player::Black : Player::White;
+    hash_ ^= whiteToMoveKey;
+
+    // the incremental hash must match a full recompute
+    assert(hash_ == generate_hash());
+    assert(pawn_hash_ == generate_pawn_hash());
+
+    undo_stack_.push_back(state);
+    position_hash_history_.push_back(hash_);
+    if (repetition_table_enabled_) {
+        repetition_table_.add(hash_);
+    }
+}
+
+void ChessBoard::unmake_move() {
+    const UndoState state = undo_stack_.back();
+    undo_stack_.pop_back();
+    if (repetition_table_enabled_) {
+        repetition_table_.remove(hash_);
+    }
+    position_hash_history_.pop_back();
+
+    player_ = (player_ == Player::White) ? Player::Black : Player::White;
+    if (player_ == Player::Black) {
+        fullmove_number_--;
+    }
+
+    int from = state.move.from();
+    int to = state.move.to();
+    int color = player_ == Player::White ? 0 : 1;
+    PieceType moved = piece_on_[to];
+
+    if (state.move.promotion()) {
+        remove_piece(color, moved, to);
+        put_piece(color, Pawn, to);
+        moved = Pawn;
+    }
+
+    move_piece(color, moved, to, from);
+
+    if (moved == King && abs(from - to) == 2) {
+        int rook_from = to > from ? from + 3 : from - 4;
+        int rook_to = (from + to) / 2;
+        move_piece(color, Rook, rook_to, rook_from);
+    }
+
+    if (state.captured != NoPiece) {
+        int captured = to;
+        if (moved == Pawn && state.en_passant == to) {
+            captured = player_ == Player::White ? to - 8 : to + 8;
+        }
+        put_piece(color ^ 1, state.captured, captured);
+    }
+
+    castling_rights_ = state.castling_rights;
+    en_passant_.reset();
+    if (state.en_passant >= 0) {
+        en_passant_.set(state.en_passant);
+    }
+    fifty_move_rule_ = state.fifty_move_rule;
+    hash_ = state.hash;
+}
+
+void ChessBoard::put_piece(int color, PieceType type, int square) {
+    pieces(type).set(square);
+    colored_pieces_[color][type].set(square);
+    (color == 0 ? white_pieces_ : black_pieces_).set(square);
+    all_pieces_.set(square);
+    piece_on_[square] = type;
+    mg_score_ += piece_square_tables.mg[color][type][square];
+    eg_score_ += piece_square_tables.eg[color][type][square];
+    phase_ += phase_weights[type];
+    if (type == Pawn) {
+        pawn_hash_ ^= PieceKeys[color][Pawn][square];
+    }
+}
+
+void ChessBoard::remove_piece(int color, PieceType type, int square) {
+    pieces(type).clear(square);
+    colored_pieces_[color][type].clear(square);
+    (color == 0 ? white_pieces_ : black_pieces_).clear(square);
+    all_pieces_.clear(square);
+    piece_on_[square] = NoPiece;
+    mg_score_ -= piece_square_tables.mg[color][type][square];
+    eg_score_ -= piece_square_tables.eg[color][type][square];
+    phase_ -= phase_weights[type];
+    if (type == Pawn) {
+        pawn_hash_ ^= PieceKeys[color][Pawn][square];
+    }
+}
+
+void ChessBoard::move_piece(int color, PieceType type, int from, int to) {
+    pieces(type).update(from, to);
+    colored_pieces_[color][type].update(from, to);
+    (color == 0 ? white_pieces_ : black_pieces_).update(from, to);
+    all_pieces_.update(from, to);
+    piece_on_[from] = NoPiece;
+    piece_on_[to] = type;
+    mg_score_ += piece_square_tables.mg[color][type][to] -
+                 piece_square_tables.mg[color][type][from];
+    eg_score_ += piece_square_tables.eg[color][type][to] -
+                 piece_square_tables.eg[color][type][from];
+    if (type == Pawn) {
+        pawn_hash_ ^= PieceKeys[color][Pawn][from] ^ PieceKeys[color][Pawn][to];
     }
 }
 
@@ -152,26 +275,33 @@ Bitboard ChessBoard::generate_moves(Square from) const {
         white_pieces_.get(from) ? white_pieces_ : black_pieces_;
     Bitboard moves(0);
 
-    if (pawns_.get(from)) {
+    switch (piece_on_[from.square_]) {
+    case Pawn:
         if (white_pieces_.get(from)) {
             moves = generate_white_pawn_moves(from, all_pieces_,
                                               black_pieces_ | en_passant_);
-        } else if (black_pieces_.get(from)) {
+        } else {
             moves = generate_black_pawn_moves(from, all_pieces_,
                                               white_pieces_ | en_passant_);
         }
-    } else if (knights_.get(from)) {
+        break;
+    case Knight:
         moves = generate_knight_moves(from);
-    } else if (bishops_.get(from)) {
+        break;
+    case Bishop:
         moves = generate_bishop_moves(from, all_pieces_);
-    } else if (rooks_.get(from)) {
+        break;
+    case Rook:
         moves = generate_rook_moves(from, all_pieces_);
-    } else if (queens_.get(from)) {
+        break;
+    case Queen:
         moves = generate_queen_moves(from, all_pieces_);
-    } else if (kings_.get(from)) {
+        break;
+    case King:
         moves = generate_king_moves(from);
-    } else {
-        moves = Bitboard(0);
+        break;
+    default:
+        break;
     }
 
     // Remove moves that would capture our own pieces
@@ -180,100 +310,312 @@ Bitboard ChessBoard::generate_moves(Square from) const {
     return moves;
 }
 
-Bitboard ChessBoard::generate_legal_moves(Square from) const {
+Bitboard ChessBoard::generate_legal_moves(Square from) {
     Bitboard moves = generate_moves(from);
     // add castling moves
-    if (kings_.get(from)) {
-        if (from == 4) {
-            Bitboard all_black_moves = Bitboard(0);
-            for (auto from : black_pieces_) {
-                all_black_moves |= generate_moves(from);
-                if (pawns_.get(from)) {
-                    all_black_moves.set(from.square_ + 7);
-                    all_black_moves.set(from.square_ + 9);
-                }
-            }
-
-            // can castle if no squares occupied or attacked between king and
-            // rook, and castling rights are set
-            bool can_white_castle_kingside =
-                (all_black_moves & white_kingside_squares).empty() &&
-                (all_pieces_ & (white_kingside_squares & ~kings_)).empty() &&
-                (castling_rights_ & 1);
-            bool can_white_castle_queenside =
-                (all_black_moves & white_queenside_squares).empty() &&
-                (all_pieces_ & (white_queenside_squares & ~kings_)).empty() &&
-                (castling_rights_ & 2);
-
-            if (can_white_castle_kingside) {
-                moves.set(6);
-            }
-            if (can_white_castle_queenside) {
-                moves.set(2);
-            }
-        } else if (from == 60) {
-            Bitboard all_white_moves = Bitboard(0);
-            for (auto from : white_pieces_) {
-                all_white_moves |= generate_moves(from);
-                // pawn attacks on castling squares even if no pieces are there
-                if (pawns_.get(from)) {
-                    all_white_moves.set(from.square_ + 7);
-                    all_white_moves.set(from.square_ + 9);
-                }
-            }
-
-            // can castle if no squares occupied or attacked between king and
-            // rook, and castling rights are set
-            bool can_black_castle_kingside =
-                (all_white_moves & black_kingside_squares).empty() &&
-                (all_pieces_ & (black_kingside_squares & ~kings_)).empty() &&
-                (castling_rights_ & 4);
-
-            bool can_black_castle_queenside =
-                (all_white_moves & black_queenside_squares).empty() &&
-                (all_pieces_ & (black_queenside_squares & ~kings_)).empty() &&
-                (castling_rights_ & 8);
-
-            if (can_black_castle_kingside) {
-                moves.set(62);
+    if (piece_on_[from.square_] == King && (from == 4 || from == 60)) {
+        Player opponent =
+            white_pieces_.get(from) ? Player::Black : Player::White;
+        int shift = from.square_ - 4;
+        int kingside = shift == 0 ? 1 : 4;
+        int queenside = shift == 0 ? 2 : 8;
+
+        // can castle if no squares occupied or attacked between king and
+        // rook, and castling rights are set
+        if (!is_square_attacked(from, opponent)) {
+            if ((castling_rights_ & kingside) &&
+                (all_pieces_ & (kingside_castling_empty << shift)).empty() &&
+                !is_square_attacked(5 + shift, opponent) &&
+                !is_square_attacked(6 + shift, opponent)) {
+                moves.set(6 + shift);
             }
-            if (can_black_castle_queenside) {
-                moves.set(58);
+            if ((castling_rights_ & queenside) &&
+                (all_pieces_ & (queenside_castling_empty << shift)).empty() &&
+                !is_square_attacked(3 + shift, opponent) &&
+                !is_square_attacked(2 + shift, opponent)) {
+                moves.set(2 + shift);
             }
         }
     }
     // remove moves that would put our king in check
     // e.g. pins, illegal king moves
+    Player player = player_;
     for (auto to : moves) {
-        ChessBoard temp_board = *this;
-        temp_board.act(Move(from, to, '\0'), false);
-        if (temp_board.is_player_in_check(player_)) {
+        make_move(Move(from, to, '\0'));
+        if (is_player_in_check(player)) {
             moves.clear(to);
         }
+        unmake_move();
     }
     return moves;
 }
 
-bool ChessBoard::is_player_in_check(Player player) const {
-    Bitboard their_pieces = this->their_pieces(player);
-    Bitboard our_king = our_pieces(player) & kings_;
-    Square our_king_position = Square(our_king.getLSB());
-
-    for (auto from : their_pieces) {
-        Bitboard moves = generate_moves(from);
-        if (moves.get(our_king_position)) {
-            return true;
+Bitboard ChessBoard::attackers_to(Square square, Bitboard occupancy) const {
+    return (white_pawn_captures[square.square_] &
+            pieces(Player::Black, Pawn)) |
+           (black_pawn_captures[square.square_] &
+            pieces(Player::White, Pawn)) |
+           (knight_attacks[square.square_] & knights_) |
+           (king_attacks[square.square_] & kings_) |
+           (generate_bishop_moves(square, occupancy) & (bishops_ | queens_)) |
+           (generate_rook_moves(square, occupancy) & (rooks_ | queens_));
+}
+
+Bitboard ChessBoard::attacked_squares(Player player,
+                                      Bitboard occupancy) const {
+    Bitboard queens = pieces(player, Queen);
+    Bitboard attacked(0);
+
+    for (auto from : pieces(player, Pawn)) {
+        attacked |= player == Player::White
+                        ? white_pawn_captures[from.square_]
+                        : black_pawn_captures[from.square_];
+    }
+    for (auto from : pieces(player, Knight)) {
+        attacked |= knight_attacks[from.square_];
+    }
+    for (auto from : pieces(player, Bishop) | queens) {
+        attacked |= generate_bishop_moves(from, occupancy);
+    }
+    for (auto from : pieces(player, Rook) | queens) {
+        attacked |= generate_rook_moves(from, occupancy);
+    }
+    for (auto from : pieces(player, King)) {
+        attacked |= king_attacks[from.square_];
+    }
+
+    return attacked;
+}
+
+// add a pawn move to every target square from the square offset behind it,
+// with all four promotions on the first and last rank
+static void add_pawn_moves(MoveList &moves, Bitboard targets, int offset) {
+    for (auto to : targets & Bitboard(~(rank_1 | rank_8))) {
+        moves.push_back(Move(to.square_ - offset, to.square_));
+    }
+    for (auto to : targets & Bitboard(rank_1 | rank_8)) {
+        int from = to.square_ - offset;
+        moves.push_back(Move(from, to.square_, 'q'));
+        moves.push_back(Move(from, to.square_, 'r'));
+        moves.push_back(Move(from, to.square_, 'b'));
+        moves.push_back(Move(from, to.square_, 'n'));
+    }
+}
+
+void ChessBoard::generate_legal_moves(MoveList &moves) const {
+    add_legal_moves<false>(moves);
+}
+
+bool ChessBoard::has_legal_move() const {
+    MoveList moves;
+    add_legal_moves<true>(moves);
+    return !moves.empty();
+}
+
+template <bool first_only>
+void ChessBoard::add_legal_moves(MoveList &moves) const {
+    moves.clear();
+
+    Player opponent = player_ == Player::White ? Player::Black : Player::White;
+    Bitboard us = our_pieces();
+    Bitboard them = their_pieces();
+    Bitboard our_king = pieces(player_, King);
+    int king = our_king.getLSB();
+
+    // the king must not stay on a slider's ray, so it is removed from the
+    // occupancy when computing the squares it cannot move to
+    Bitboard attacked = attacked_squares(opponent, all_pieces_ & ~our_king);
+    Bitboard checkers = attackers_to(king, all_pieces_) & them;
+
+    for (auto to : king_attacks[king] & ~us & ~attacked) {
+        moves.push_back(Move(king, to));
+    }
+
+    // only the king can move out of a double check
+    if (checkers.count() > 1 || (first_only && !moves.empty())) {
+        return;
+    }
+
+    // other pieces must capture the checker or block the check
+    Bitboard check_mask(~0ULL);
+    if (!checkers.empty()) {
+        int checker = checkers.getLSB();
+        check_mask = between_squares[king][checker] | checkers;
+    }
+
+    // pinned pieces may only move along the ray between king and pinner
+    Bitboard pinned(0);
+    Bitboard pin_rays[64];
+    Bitboard pinners =
+        (generate_rook_moves(king, Bitboard(0)) & them & (rooks_ | queens_)) |
+        (generate_bishop_moves(king, Bitboard(0)) & them &
+         (bishops_ | queens_));
+    for (auto pinner : pinners) {
+        Bitboard blockers = between_squares[king][pinner.square_] & all_pieces_;
+        if (blockers.count() == 1 && !(blockers & us).empty()) {
+            int square = blockers.getLSB();
+            pinned.set(square);
+            pin_rays[square] = between_squares[king][pinner.square_];
+            pin_rays[square].set(pinner);
         }
     }
-    return false;
+
+    // unpinned pawns are generated together below
+    Bitboard free_pawns = pieces(player_, Pawn) & ~pinned;
+    int promotion_rank = player_ == Player::White ? 7 : 0;
+    for (auto from : us & ~kings_ & ~free_pawns) {
+        Bitboard targets(0);
+        bool pawn = false;
+
+        switch (piece_on_[from.square_]) {
+        case Pawn:
+            pawn = true;
+            if (player_ == Player::White) {
+                targets = generate_white_pawn_moves(from, all_pieces_, them);
+            } else {
+                targets = generate_black_pawn_moves(from, all_pieces_, them);
+            }
+            break;
+        case Knight:
+            targets = knight_attacks[from.square_];
+            break;
+        case Bishop:
+            targets = generate_bishop_moves(from, all_pieces_);
+            break;
+        case Rook:
+            targets = generate_rook_moves(from, all_pieces_);
+            break;
+        case Queen:
+            targets = generate_queen_moves(from, all_pieces_);
+            break;
+        default:
+            break;
+        }
+
+        targets &= ~us & check_mask;
+        if (pinned.get(from)) {
+            targets &= pin_rays[from.square_];
+        }
+
+        for (auto to : targets) {
+            if (pawn && to.rank_ == promotion_rank) {
+                moves.push_back(Move(from, to, 'q'));
+                moves.push_back(Move(from, to, 'r'));
+                moves.push_back(Move(from, to, 'b'));
+                moves.push_back(Move(from, to, 'n'));
+            } else {
+                moves.push_back(Move(from, to));
+            }
+        }
+        if (first_only && !moves.empty()) {
+            return;
+        }
+    }
+
+    Bitboard empty = ~all_pieces_;
+    Bitboard captures = them & check_mask;
+    if (player_ == Player::White) {
+        add_pawn_moves(moves, white_pawn_pushes(free_pawns, empty) & check_mask,
+                       8);
+        add_pawn_moves(moves,
+                       white_pawn_double_pushes(free_pawns, empty) &
+                           check_mask,
+                       16);
+        add_pawn_moves(moves, white_pawn_captures_west(free_pawns) & captures,
+                       7);
+        add_pawn_moves(moves, white_pawn_captures_east(free_pawns) & captures,
+                       9);
+    } else {
+        add_pawn_moves(moves, black_pawn_pushes(free_pawns, empty) & check_mask,
+                       -8);
+        add_pawn_moves(moves,
+                       black_pawn_double_pushes(free_pawns, empty) &
+                           check_mask,
+                       -16);
+        add_pawn_moves(moves, black_pawn_captures_west(free_pawns) & captures,
+                       -9);
+        add_pawn_moves(moves, black_pawn_captures_east(free_pawns) & captures,
+                       -7);
+    }
+    if (first_only && !moves.empty()) {
+        return;
+    }
+
+    if (!en_passant_.empty()) {
+        int to = en_passant_.getLSB();
+        int captured = player_ == Player::White ? to - 8 : to + 8;
+        // our pawns attacking the en passant square
+        Bitboard attackers = (player_ == Player::White
+                                  ? black_pawn_captures[to]
+                                  : white_pawn_captures[to]) &
+                             pieces(player_, Pawn);
+
+        if (check_mask.get(to) || check_mask.get(captured)) {
+            for (auto from : attackers) {
+                // both pawns leave their squares at once, so test for
+                // discovered slider attacks on the resulting occupancy
+                Bitboard occupancy = all_pieces_;
+                occupancy.clear(from);
+                occupancy.clear(captured);
+                occupancy.set(to);
+                Bitboard sliders =
+                    (generate_rook_moves(king, occupancy) & them &
+                     (rooks_ | queens_)) |
+                    (generate_bishop_moves(king, occupancy) & them &
+                     (bishops_ | queens_));
+                if (sliders.empty()) {
+                    moves.push_back(Move(from, to));
+                }
+            }
+        }
+    }
+
+    // castling through or out of check is illegal
+    if (checkers.empty()) {
+        int shift = player_ == Player::White ? 0 : 56;
+        int kingside = player_ == Player::White ? 1 : 4;
+        int queenside = player_ == Player::White ? 2 : 8;
+        Bitboard rooks = pieces(player_, Rook);
+
+        if ((castling_rights_ & kingside) && rooks.get(7 + shift) &&
+            (all_pieces_ & (kingside_castling_empty << shift)).empty() &&
+            (attacked & (kingside_castling_safe << shift)).empty()) {
+            moves.push_back(Move(4 + shift, 6 + shift));
+        }
+        if ((castling_rights_ & queenside) && rooks.get(shift) &&
+            (all_pieces_ & (queenside_castling_empty << shift)).empty() &&
+            (attacked & (queenside_castling_safe << shift)).empty()) {
+            moves.push_back(Move(4 + shift, 2 + shift));
+        }
+    }
+}
+
+bool ChessBoard::is_player_in_check(Player player) const {
+    Player opponent = player == Player::White ? Player::Black : Player::White;
+    return is_square_attacked(pieces(player, King).getLSB(), opponent);
+}
+
+bool ChessBoard::is_square_attacked(Square square, Player by) const {
+    int i = square.square_;
+    // a pawn attacks the square if a pawn of the other color standing on the
+    // square would capture it
+    Bitboard pawn_attacks = by == Player::White ? black_pawn_captures[i]
+                                                : white_pawn_captures[i];
+    Bitboard queens = pieces(by, Queen);
+
+    return !(pawn_attacks & pieces(by, Pawn)).empty() ||
+           !(knight_attacks[i] & pieces(by, Knight)).empty() ||
+           !(king_attacks[i] & pieces(by, King)).empty() ||
+           !(generate_bishop_moves(square, all_pieces_) &
+             (pieces(by, Bishop) | queens))
+                .empty() ||
+           !(generate_rook_moves(square, all_pieces_) &
+             (pieces(by, Rook) | queens))
+                .empty();
 }
 
 void ChessBoard::update_game_state() {
-    Bitboard all_moves = Bitboard(0);
-    for (auto from : our_pieces()) {
-        all_moves |= generate_legal_moves(from);
-    }
-    if (all_moves.empty()) {
+    if (!has_legal_move()) {
         if (is_player_in_check(player_)) {
             // Checkmate
             if (player_ == Player::White) {
@@ -305,10 +647,10 @@ bool ChessBoard::has_mating_material() const {
         return true;
     }
 
-    int num_white_bishops = (bishops_ & white_pieces_).count();
-    int num_black_bishops = (bishops_ & black_pieces_).count();
-    int num_white_knights = (knights_ & white_pieces_).count();
-    int num_black_knights = (knights_ & black_pieces_).count();
+    int num_white_bishops = pieces(Player::White, Bishop).count();
+    int num_black_bishops = pieces(Player::Black, Bishop).count();
+    int num_white_knights = pieces(Player::White, Knight).count();
+    int num_black_knights = pieces(Player::Black, Knight).count();
 
     if (num_white_bishops + num_white_knights > 1 ||
         num_black_bishops + num_black_knights > 1) {
@@ -318,61 +660,31 @@ bool ChessBoard::has_mating_material() const {
     return false;
 }
 
-void ChessBoard::update_draw_condition(Square from, Square to) {
-    fifty_move_rule_++;
-    // reset if pawn is moved or piece is captured
-    if (pawns_.get(from) || all_pieces_.get(to)) {
-        fifty_move_rule_ = 0;
-    }
-}
-
-void ChessBoard::castling(Square from, Square to) {
-    // remove castling rights if king or rook is moved or captured
-    if (from == 0 || to == 0) {
-        castling_rights_ &= ~2;
-    } else if (from == 7 || to == 7) {
-        castling_rights_ &= ~1;
-    } else if (from == 4 || to == 4) {
-        castling_rights_ &= ~3;
-    } else if (from == 56 || to == 56) {
-        castling_rights_ &= ~8;
-    } else if (from == 60 || to == 60) {
-        castling_rights_ &= ~12;
-    } else if (from == 63 || to == 63) {
-        castling_rights_ &= ~4;
-    }
-
-    // move rook if castling
-    if (kings_.get(from) && abs(from.file_ - to.file_) == 2) {
-        if (from == 4) {
-            if (to == 2) {
-                rooks_.update(0, 3);
-                white_pieces_.update(0, 3);
-                all_pieces_.update(0, 3);
-            } else if (to == 6) {
-                rooks_.update(7, 5);
-                white_pieces_.update(7, 5);
-                all_pieces_.update(7, 5);
-            }
-        } else if (from == 60) {
-            if (to == 58) {
-                rooks_.update(56, 59);
-                black_pieces_.update(56, 59);
-                all_pieces_.update(56, 59);
-            } else if (to == 62) {
-                rooks_.update(63, 61);
-                black_pieces_.update(63, 61);
-                all_pieces_.update(63, 61);
-            }
-        }
-    }
-}
-
 void ChessBoard::set_fen(std::string fen) {
     std::string board;
     std::istringstream fen_str(fen);
     fen_str >> board;
 
+    all_pieces_.reset();
+    white_pieces_.reset();
+    black_pieces_.reset();
+    for (int type = Pawn; type <= King; type++) {
+        pieces(static_cast<PieceType>(type)).reset();
+        colored_pieces_[0][type].reset();
+        colored_pieces_[1][type].reset();
+    }
+    std::fill(piece_on_, piece_on_ + 64, NoPiece);
+    mg_score_ = 0;
+    eg_score_ = 0;
+    phase_ = 0;
+    pawn_hash_ = 0;
+    en_passant_.reset();
+    undo_stack_.clear();
+    position_hash_history_.clear();
+    game_state_ = GameState::Playing;
+    accumulators_.resize(1);
+    accumulators_[0].computed[0] = accumulators_[0].computed[1] = false;
+
     int rank = 7;
     int file = 0;
     for (char c : board) {
@@ -386,24 +698,26 @@ void ChessBoard::set_fen(std::string fen) {
             file += c - '0';
             continue;
         }
-        if (std::isupper(c)) {
-            white_pieces_.set(i);
-        } else {
-            black_pieces_.set(i);
-        }
-        all_pieces_.set(i);
-        if (c == 'k' || c == 'K') {
-            kings_.set(i);
-        } else if (c == 'q' || c == 'Q') {
-            queens_.set(i);
-        } else if (c == 'r' || c == 'R') {
-            rooks_.set(i);
-        } else if (c == 'b' || c == 'B') {
-            bishops_.set(i);
-        } else if (c == 'n' || c == 'N') {
-            knights_.set(i);
-        } else if (c == 'p' || c == 'P') {
-            pawns_.set(i);
+        int color = std::isupper(c) ? 0 : 1;
+        switch (std::tolower(c)) {
+        case 'k':
+            put_piece(color, King, i);
+            break;
+        case 'q':
+            put_piece(color, Queen, i);
+            break;
+        case 'r':
+            put_piece(color, Rook, i);
+            break;
+        case 'b':
+            put_piece(color, Bishop, i);
+            break;
+        case 'n':
+            put_piece(color, Knight, i);
+            break;
+        case 'p':
+            put_piece(color, Pawn, i);
+            break;
         }
         file++;
     }
@@ -439,43 +753,36 @@ void ChessBoard::set_fen(std::string fen) {
         en_passant_.set(Square(en_passant_string));
     }
 
+    fifty_move_rule_ = 0;
+    fullmove_number_ = 1;
     if (!fen_str.eof())
         fen_str >> fifty_move_rule_;
     if (!fen_str.eof())
         fen_str >> fullmove_number_;
+
+    hash_ = generate_hash();
+    position_hash_history_.push_back(hash_);
+    repetition_table_.clear();
+    if (repetition_table_enabled_) {
+        repetition_table_.add(hash_);
+    }
 }
 
-uint64_t ChessBoard::generate_hash() const {
-    uint64_t hash = 0;
-    for (auto i : white_pieces_) {
-        if (pawns_.get(i)) {
-            hash ^= PieceKeys[0][0][i.square_];
-        } else if (knights_.get(i)) {
-            hash ^= PieceKeys[0][1][i.square_];
-        } else if (bishops_.get(i)) {
-            hash ^= PieceKeys[0][2][i.square_];
-        } else if (rooks_.get(i)) {
-            hash ^= PieceKeys[0][3][i.square_];
-        } else if (queens_.get(i)) {
-            hash ^= PieceKeys[0][4][i.square_];
-        } else if (kings_.get(i)) {
-            hash ^= PieceKeys[0][5][i.square_];
+void ChessBoard::set_repetition_table(bool enabled) {
+    repetition_table_enabled_ = enabled;
+    repetition_table_.clear();
+    if (enabled) {
+        for (auto hash : position_hash_history_) {
+            repetition_table_.add(hash);
         }
     }
-    for (auto i : black_pieces_) {
-        if (pawns_.get(i)) {
-            hash ^= PieceKeys[1][0][i.square_];
-        } else if (knights_.get(i)) {
-            hash ^= PieceKeys[1][1][i.square_];
-        } else if (bishops_.get(i)) {
-            hash ^= PieceKeys[1][2][i.square_];
-        } else if (rooks_.get(i)) {
-            hash ^= PieceKeys[1][3][i.square_];
-        } else if (queens_.get(i)) {
-            hash ^= PieceKeys[1][4][i.square_];
-        } else if (kings_.get(i)) {
-            hash ^= PieceKeys[1][5][i.square_];
-        }
+}
+
+uint64_t ChessBoard::generate_hash() const {
+    uint64_t hash = 0;
+    for (auto i : all_pieces_) {
+        int color = white_pieces_.get(i) ? 0 : 1;
+        hash ^= PieceKeys[color][piece_on_[i.square_]][i.square_];
     }
     if (!en_passant_.empty()) {
         int en_passant_square = en_passant_.getLSB();
@@ -500,20 +807,30 @@ uint64_t ChessBoard::generate_hash() const {
     return hash;
 }
 
+uint64_t ChessBoard::generate_pawn_hash() const {
+    uint64_t hash = 0;
+    for (int color = 0; color < 2; color++) {
+        for (auto i : colored_pieces_[color][Pawn]) {
+            hash ^= PieceKeys[color][Pawn][i.square_];
+        }
+    }
+    return hash;
+}
+
 std::vector<uint64_t> ChessBoard::get_position_info() const {
     std::vector<uint64_t> position;
-    position.push_back((white_pieces_ & pawns_).bitboard_);
-    position.push_back((black_pieces_ & pawns_).bitboard_);
-    position.push_back((white_pieces_ & bishops_).bitboard_);
-    position.push_back((black_pieces_ & bishops_).bitboard_);
-    position.push_back((white_pieces_ & rooks_).bitboard_);
-    position.push_back((black_pieces_ & rooks_).bitboard_);
-    position.push_back((white_pieces_ & queens_).bitboard_);
-    position.push_back((black_pieces_ & queens_).bitboard_);
-    position.push_back((white_pieces_ & kings_).bitboard_);
-    position.push_back((black_pieces_ & kings_).bitboard_);
-    position.push_back((white_pieces_ & knights_).bitboard_);
-    position.push_back((black_pieces_ & knights_).bitboard_);
+    position.push_back(pieces(Player::White, Pawn).bitboard_);
+    position.push_back(pieces(Player::Black, Pawn).bitboard_);
+    position.push_back(pieces(Player::White, Bishop).bitboard_);
+    position.push_back(pieces(Player::Black, Bishop).bitboard_);
+    position.push_back(pieces(Player::White, Rook).bitboard_);
+    position.push_back(pieces(Player::Black, Rook).bitboard_);
+    position.push_back(pieces(Player::White, Queen).bitboard_);
+    position.push_back(pieces(Player::Black, Queen).bitboard_);
+    position.push_back(pieces(Player::White, King).bitboard_);
+    position.push_back(pieces(Player::Black, King).bitboard_);
+    position.push_back(pieces(Player::White, Knight).bitboard_);
+    position.push_back(pieces(Player::Black, Knight).bitboard_);
 
     int repetitions = get_repetition_count();
     if (repetitions == 0) {
@@ -3,19 +3,20 @@
 #include "bitboard.h"
 #include "move.h"
 #include "move_generator.h"
+#include "nnue.h"
+#include "repetition_table.h"
+#include "zobrist.h"
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
 
-extern uint64_t piece_keys[2][6][64];
-extern uint64_t castle_keys[4];
-extern uint64_t en_passant_keys[8];
-extern uint64_t white_to_move_key;
-
-const uint64_t white_kingside_squares = 0x0000000000000070;
-const uint64_t white_queenside_squares = 0x000000000000001C;
-const uint64_t black_kingside_squares = 0x7000000000000000;
-const uint64_t black_queenside_squares = 0x1C00000000000000;
+// white squares between king and rook that must be empty, and squares the
+// king passes that must not be attacked, shifted by 56 for black
+const uint64_t kingside_castling_empty = 0x60;
+const uint64_t queenside_castling_empty = 0x0E;
+const uint64_t kingside_castling_safe = 0x60;
+const uint64_t queenside_castling_safe = 0x0C;
 const std::string starting_fen =
     "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 
@@ -28,7 +29,17 @@ enum class GameState {
 
 enum class Player { White, Black };
 
-void init_keys();
+enum PieceType { Pawn, Knight, Bishop, Rook, Queen, King, NoPiece };
+
+// irreversible state saved by make_move() and restored by unmake_move()
+struct UndoState {
+    Move move;
+    PieceType captured;
+    uint8_t castling_rights;
+    int8_t en_passant;
+    int16_t fifty_move_rule;
+    uint64_t hash;
+};
 
 class ChessBoard {
   public:
@@ -40,20 +51,63 @@ class ChessBoard {
 
     std::string to_string() const;
     bool act(Move move, bool update = true);
-    void check_en_passant(Square from, Square to);
-    void check_promotion(char promotion, Square from);
+    // play a move and push its undo state, no legality checks are done
+    void make_move(Move move);
+    // take back the last move played with make_move()
+    void unmake_move();
+    inline PieceType piece_type_on(int square) const {
+        return piece_on_[square];
+    }
+    inline PieceType piece_type_on(Square square) const {
+        return piece_on_[square.square_];
+    }
+    // add, remove or move a piece in the mailbox and every bitboard
+    void put_piece(int color, PieceType type, int square);
+    void remove_piece(int color, PieceType type, int square);
+    void move_piece(int color, PieceType type, int from, int to);
     bool has_mating_material() const;
     bool is_player_in_check(Player player) const;
+    // reverse lookup from the square through the attack tables
+    bool is_square_attacked(Square square, Player by) const;
     // generate pseudolegal moves
     Bitboard generate_moves(Square square) const;
     // remove moves from generateMoves that would leave the king in check
-    Bitboard generate_legal_moves(Square square) const;
+    Bitboard generate_legal_moves(Square square);
+    // generate every legal move of the side to move using check and pin masks
+    void generate_legal_moves(MoveList &moves) const;
+    // whether the side to move has a legal move, without generating them all
+    bool has_legal_move() const;
+    // shared by the two above, returns after the first move if first_only
+    template <bool first_only> void add_legal_moves(MoveList &moves) const;
+    // pieces of either color attacking a square given an occupancy
+    Bitboard attackers_to(Square square, Bitboard occupancy) const;
+    // squares attacked by a player's pieces given an occupancy
+    Bitboard attacked_squares(Player player, Bitboard occupancy) const;
     std::vector<uint64_t> get_position_info() const;
     void update_game_state();
-    void update_draw_condition(Square from, Square to);
-    void castling(Square from, Square to);
     void set_fen(std::string fen);
+    // recompute the position hash from scratch
     uint64_t generate_hash() const;
+    uint64_t generate_pawn_hash() const;
+    inline Bitboard &pieces(PieceType type) {
+        switch (type) {
+        case Pawn:
+            return pawns_;
+        case Knight:
+            return knights_;
+        case Bishop:
+            return bishops_;
+        case Rook:
+            return rooks_;
+        case Queen:
+            return queens_;
+        default:
+            return kings_;
+        }
+    }
+    inline Bitboard pieces(Player player, PieceType type) const {
+        return colored_pieces_[static_cast<int>(player)][type];
+    }
     inline Bitboard our_pieces(Player player) const {
         return player == Player::White ? white_pieces_ : black_pieces_;
     }
@@ -62,19 +116,37 @@ class ChessBoard {
         return player == Player::White ? black_pieces_ : white_pieces_;
     }
     inline Bitboard their_pieces() const { return their_pieces(player_); }
+    // earlier occurrences of the current position. positions from before
+    // the last capture or pawn move cannot repeat, so only those after it
+    // are scanned, or the counting table answers directly when enabled
     inline int get_repetition_count() const {
+        if (repetition_table_enabled_) {
+            return repetition_table_.count(hash_) - 1;
+        }
         int repetitions = 0;
-        for (int i = position_hash_history_.size() - 3; i >= 0; i -= 2) {
+        int first = std::max(0, static_cast<int>(position_hash_history_.size()) -
+                                    1 - fifty_move_rule_);
+        for (int i = position_hash_history_.size() - 3; i >= first; i -= 2) {
             if (position_hash_history_[i] == position_hash_history_.back()) {
                 repetitions++;
             }
         }
         return repetitions;
     }
+    // count positions in a hash table as they are played, for long games
+    void set_repetition_table(bool enabled);
 
     GameState game_state_;
     Player player_;
+    // zobrist hash, updated incrementally by make_move()
+    uint64_t hash_;
+    // zobrist hash of the pawns alone, kept by put_piece(), remove_piece()
+    // and move_piece() for the pawn structure cache
+    uint64_t pawn_hash_;
     std::vector<uint64_t> position_hash_history_;
+    bool repetition_table_enabled_ = false;
+    RepetitionTable repetition_table_;
+    std::vector<UndoState> undo_stack_;
     int fifty_move_rule_;
     int fullmove_number_;
     int castling_rights_;
@@ -91,4 +163,19 @@ class ChessBoard {
     Bitboard rooks_;
     Bitboard queens_;
     Bitboard kings_;
+
+    // pieces of each color and type, indexed by Player and PieceType
+    Bitboard colored_pieces_[2][6];
+    // piece type on each square, NoPiece if empty
+    PieceType piece_on_[64];
+
+    // material and piece-square sums from white's point of view and the game
+    // phase, kept by put_piece(), remove_piece() and move_piece()
+    int mg_score_;
+    int eg_score_;
+    int phase_;
+
+    // network accumulators indexed by undo_stack_ size, filled in lazily by
+    // evaluate_nnue() from the pieces each make_move() changed
+    mutable std::vector<NnueAccumulator> accumulators_;
 };
@@ -1,74 +1,62 @@
 #include "engine.h"
 #include "chessboard.h"
+#include "nnue.h"
+#include "thread_budget.h"
 
-std::vector<Move> moves;
-ChessBoard board;
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstring>
+#include <sstream>
+#include <thread>
 
-void init_engine() {
-    init_keys();
-    init_sliding_moves();
-    reset_engine();
-}
+std::unique_ptr<TranspositionTable> transposition_table;
+
+// results a batch worker may be ahead of the one being emitted
+const size_t analysis_window_per_thread = 64;
 
-void reset_engine() {
-    board = ChessBoard();
-    moves.clear();
+void init_engine(size_t transposition_mb, const std::string &network_file) {
+    transposition_table =
+        std::make_unique<TranspositionTable>(transposition_mb);
+    load_network(network_file);
 }
 
-bool act(std::string move_string) {
-    Move move = Move(move_string);
+bool GameSession::act(std::string move_string) {
+    Move move(move_string);
     if (is_legal_move(move)) {
-        board.act(move);
-        moves.push_back(move);
+        board_.act(move);
+        moves_.push_back(move);
+        legal_moves_valid_ = false;
         return true;
     } else {
         return false;
     }
 }
 
-std::vector<Move> get_legal_moves() {
-    std::vector<Move> legal_moves;
-
-    for (auto from : board.our_pieces()) {
-        Bitboard moves = board.generate_legal_moves(from);
-
-        for (auto to : moves) {
-            if (board.pawns_.get(from) &&
-                ((to.rank_ == 7) || (to.rank_ == 0))) {
-                legal_moves.push_back(Move(from, to, 'q'));
-                legal_moves.push_back(Move(from, to, 'r'));
-                legal_moves.push_back(Move(from, to, 'b'));
-                legal_moves.push_back(Move(from, to, 'n'));
-            } else {
-                legal_moves.push_back(Move(from, to));
-            }
-        }
+const MoveList &GameSession::get_legal_moves() const {
+    if (!legal_moves_valid_) {
+        board_.generate_legal_moves(legal_moves_);
+        legal_moves_valid_ = true;
     }
-
-    return legal_moves;
+    return legal_moves_;
 }
 
-bool is_legal_move(Move move) {
-    Square from = move.from_;
-    Square to = move.to_;
-
-    // promotion from non-pawn piece is illegal
-    if (!board.pawns_.get(from) && move.promotion_ != '\0') {
-        return false;
-    }
+Move GameSession::generate_move(const SearchLimits &limits) const {
+    return search(board_, limits, transposition_table.get()).best_move;
+}
 
-    // non-promotion move to promotion square is illegal:q
-    if (board.pawns_.get(from) && (to.rank_ == 7 || to.rank_ == 0) &&
-        move.promotion_ == '\0') {
-        return false;
-    }
+bool GameSession::is_legal_move(Move move) const {
+    const MoveList &legal_moves = get_legal_moves();
+    return std::find(legal_moves.begin(), legal_moves.end(), move) !=
+           legal_moves.end();
+}
 
-    return board.generate_legal_moves(from).get(to) &&
-           board.our_pieces().get(from);
+std::string GameSession::get_game_state() const {
+    return game_state_name(board_.game_state_);
 }
 
-std::string get_game_state() {
-    switch (board.game_state_) {
+std::string game_state_name(GameState state) {
+    switch (state) {
     case GameState::Playing:
         return "playing";
     case GameState::WhiteWin:
@@ -82,27 +70,252 @@ std::string get_game_state() {
     }
 }
 
-bool is_check() { return board.is_player_in_check(board.player_); }
+bool GameSession::is_check() const {
+    return board_.is_player_in_check(board_.player_);
+}
 
-std::string get_board() {
+std::string GameSession::get_board() const {
     std::string board_str;
     for (int i = 0; i < 64; i++) {
-        if (board.pawns_.get(i)) {
-            board_str += board.white_pieces_.get(i) ? 'P' : 'p';
-        } else if (board.knights_.get(i)) {
-            board_str += board.white_pieces_.get(i) ? 'N' : 'n';
-        } else if (board.bishops_.get(i)) {
-            board_str += board.white_pieces_.get(i) ? 'B' : 'b';
-        } else if (board.rooks_.get(i)) {
-            board_str += board.white_pieces_.get(i) ? 'R' : 'r';
-        } else if (board.queens_.get(i)) {
-            board_str += board.white_pieces_.get(i) ? 'Q' : 'q';
-        } else if (board.kings_.get(i)) {
-            board_str += board.white_pieces_.get(i) ? 'K' : 'k';
-        } else {
-            board_str += '.';
+        PieceType type = board_.piece_type_on(i);
+        char piece = type == NoPiece ? '.' : "pnbrqk"[type];
+        if (board_.white_pieces_.get(i)) {
+            piece = std::toupper(piece);
         }
+        board_str += piece;
     }
 
     return board_str;
-}
\ No newline at end of file
+}
+
+bool validate_fen(const std::string &fen, std::string &error) {
+    ChessBoard board;
+    return load_fen(board, fen, error);
+}
+
+bool load_fen(ChessBoard &board, const std::string &fen, std::string &error) {
+    std::istringstream fields(fen);
+    std::string placement;
+    std::string side = "w";
+    std::string castling = "-";
+    std::string en_passant = "-";
+    fields >> placement;
+
+    // squares[square] is the fen piece letter or 0
+    char squares[64] = {};
+    int kings[2] = {0, 0};
+    int rank = 7;
+    int file = 0;
+    for (char c : placement) {
+        if (c == '/') {
+            if (file != 8 || rank == 0) {
+                error = "ranks must have 8 squares";
+                return false;
+            }
+            rank--;
+            file = 0;
+            continue;
+        }
+        if (c >= '1' && c <= '8') {
+            file += c - '0';
+        } else if (std::strchr("pnbrqkPNBRQK", c)) {
+            if (file < 8) {
+                squares[rank * 8 + file] = c;
+            }
+            if (std::tolower(c) == 'p' && (rank == 0 || rank == 7)) {
+                error = "pawn on the first or last rank";
+                return false;
+            }
+            if (std::tolower(c) == 'k') {
+                kings[std::isupper(c) ? 0 : 1]++;
+            }
+            file++;
+        } else {
+            error = std::string("invalid character '") + c + "'";
+            return false;
+        }
+        if (file > 8) {
+            error = "ranks must have 8 squares";
+            return false;
+        }
+    }
+    if (rank != 0 || file != 8) {
+        error = "board must have 8 ranks";
+        return false;
+    }
+    if (kings[0] != 1 || kings[1] != 1) {
+        error = "each side needs exactly one king";
+        return false;
+    }
+
+    fields >> side >> castling >> en_passant;
+    if (side != "w" && side != "b") {
+        error = "side to move must be w or b";
+        return false;
+    }
+    // each right needs the king and rook on their starting squares
+    const char *rights = "KQkq";
+    const char rooks[] = {'R', 'R', 'r', 'r'};
+    const int rook_squares[] = {7, 0, 63, 56};
+    for (char c : castling) {
+        if (castling == "-") {
+            break;
+        }
+        const char *right = c ? std::strchr(rights, c) : nullptr;
+        if (!right) {
+            error = "invalid castling rights";
+            return false;
+        }
+        int i = right - rights;
+        if (squares[i < 2 ? 4 : 60] != (i < 2 ? 'K' : 'k') ||
+            squares[rook_squares[i]] != rooks[i]) {
+            error = std::string("castling right ") + c +
+                    " without king and rook at home";
+            return false;
+        }
+    }
+    if (en_passant != "-") {
+        // the pawn that just moved two squares stands in front of the target
+        int target_rank = side == "w" ? 5 : 2;
+        int pawn_rank = side == "w" ? 4 : 3;
+        if (en_passant.size() != 2 || en_passant[0] < 'a' ||
+            en_passant[0] > 'h' || en_passant[1] - '1' != target_rank) {
+            error = "invalid en passant square";
+            return false;
+        }
+        int target_file = en_passant[0] - 'a';
+        if (squares[target_rank * 8 + target_file] ||
+            squares[pawn_rank * 8 + target_file] != (side == "w" ? 'p' : 'P')) {
+            error = "en passant square without a pawn that just moved";
+            return false;
+        }
+    }
+    std::string number;
+    while (fields >> number) {
+        if (number.find_first_not_of("0123456789") != std::string::npos) {
+            error = "move counters must be numbers";
+            return false;
+        }
+    }
+
+    board.set_fen(fen);
+    Player waiting = side == "w" ? Player::Black : Player::White;
+    if (board.is_player_in_check(waiting)) {
+        error = "side not to move is in check";
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+// board is reused across a worker's positions
+void analyze_position(const std::string &fen, ChessBoard &board,
+                      PositionAnalysis &analysis) {
+    analysis.fen = fen;
+    if (!load_fen(board, fen, analysis.error)) {
+        return;
+    }
+    board.generate_legal_moves(analysis.legal_moves);
+    analysis.check = board.is_player_in_check(board.player_);
+    board.update_game_state();
+    analysis.state = board.game_state_;
+}
+
+} // namespace
+
+void analyze_positions(const FenSource &next, const AnalysisSink &emit,
+                       int threads) {
+    // workers share the cores with searches and other batches
+    ThreadGrant grant(threads);
+    threads = grant.threads();
+    // results[i % window] holds result i until it is emitted
+    const size_t window = threads * analysis_window_per_thread;
+    std::vector<PositionAnalysis> results(window);
+    std::vector<char> ready(window, false);
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t taken = 0;
+    size_t emitted = 0;
+    // the source is exhausted or emit asked to stop
+    bool finished = false;
+
+    auto work = [&]() {
+        ChessBoard board;
+        std::string fen;
+        while (true) {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]() {
+                    return finished || taken - emitted < window;
+                });
+                if (finished) {
+                    return;
+                }
+                if (!next(fen)) {
+                    finished = true;
+                    changed.notify_all();
+                    return;
+                }
+                index = taken++;
+            }
+
+            PositionAnalysis analysis;
+            analysis.index = index;
+            analyze_position(fen, board, analysis);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                results[index % window] = std::move(analysis);
+                ready[index % window] = true;
+            }
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(work);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        size_t slot = emitted % window;
+        changed.wait(lock, [&]() {
+            return ready[slot] || (finished && emitted == taken);
+        });
+        if (!ready[slot]) {
+            break;
+        }
+        PositionAnalysis analysis = std::move(results[slot]);
+        ready[slot] = false;
+        lock.unlock();
+        bool more = emit(analysis);
+        lock.lock();
+        emitted++;
+        changed.notify_all();
+        if (!more) {
+            finished = true;
+            break;
+        }
+    }
+    lock.unlock();
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void analyze_positions(const std::vector<std::string> &fens,
+                       const AnalysisSink &emit, int threads) {
+    size_t next = 0;
+    analyze_positions(
+        [&](std::string &fen) {
+            if (next == fens.size()) {
+                return false;
+            }
+            fen = fens[next++];
+            return true;
+        },
+        emit, threads);
+}
@@ -3,15 +3,79 @@
 #include "chessboard.h"
 #include "move.h"
 #include "move_generator.h"
+#include "search.h"
+#include "transposition_table.h"
 
-extern std::vector<Move> moves;
-extern ChessBoard board;
-
-void init_engine();
-void reset_engine();
-std::string get_game_state();
-bool is_check();
-bool is_legal_move(Move move);
-std::vector<Move> get_legal_moves();
-bool act(std::string move);
-std::string get_board();
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+const size_t default_transposition_mb = 64;
+const std::string default_network_file = "alphachess.nnue";
+
+// search cache shared by every game, created by init_engine
+extern std::unique_ptr<TranspositionTable> transposition_table;
+
+// allocate the table and load the network, evaluation falls back to the
+// classical one when the network file is missing or invalid
+void init_engine(size_t transposition_mb = default_transposition_mb,
+                 const std::string &network_file = default_network_file);
+
+// result of analysing one position of a batch
+struct PositionAnalysis {
+    // place of the position in the batch
+    size_t index = 0;
+    std::string fen;
+    // why the fen was rejected, empty if it was valid
+    std::string error;
+    MoveList legal_moves;
+    bool check = false;
+    GameState state = GameState::Playing;
+};
+
+// stores the next fen of a batch in fen, false when there are no more
+using FenSource = std::function<bool(std::string &fen)>;
+// receives the results of a batch, returning false stops it
+using AnalysisSink = std::function<bool(const PositionAnalysis &analysis)>;
+
+// "playing", "checkmate" or "draw"
+std::string game_state_name(GameState state);
+// false with the reason in error if the fen is not a legal position that
+// ChessBoard::set_fen() can load
+bool validate_fen(const std::string &fen, std::string &error);
+// validate the fen and set up board from it in one pass, board is left in
+// an unspecified state when it is rejected
+bool load_fen(ChessBoard &board, const std::string &fen, std::string &error);
+// analyse positions on a pool of up to threads workers, fewer when other
+// searches and batches hold the cores (see thread_budget.h). results reach
+// emit on the calling thread in batch order, workers wait when they get too
+// far ahead, so the results held at once do not grow with the batch.
+void analyze_positions(const FenSource &next, const AnalysisSink &emit,
+                       int threads);
+void analyze_positions(const std::vector<std::string> &fens,
+                       const AnalysisSink &emit, int threads);
+
+// a single game: the board and the moves played from the starting position
+class GameSession {
+  public:
+    GameSession() { board_.set_repetition_table(true); }
+
+    std::string get_game_state() const;
+    bool is_check() const;
+    bool is_legal_move(Move move) const;
+    // legal moves of the current position, generated once per position
+    const MoveList &get_legal_moves() const;
+    bool act(std::string move);
+    std::string get_board() const;
+    Move generate_move(const SearchLimits &limits) const;
+
+    // held by callers for the duration of a request on this game
+    std::mutex mutex_;
+    ChessBoard board_;
+    std::vector<Move> moves_;
+    // cache for get_legal_moves(), cleared by act()
+    mutable MoveList legal_moves_;
+    mutable bool legal_moves_valid_ = false;
+};
@@ -0,0 +1,346 @@
+#include "evaluate.h"
+#include "move_generator.h"
+#include "nnue.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+
+// PeSTO material and piece-square tables, written with a8 first so white
+// reads them through square ^ 56 and black reads them directly
+constexpr int mg_values[6] = {82, 337, 365, 477, 1025, 0};
+constexpr int eg_values[6] = {94, 281, 297, 512, 936, 0};
+
+constexpr int mg_tables[6][64] = {
+    // pawn
+    {0,   0,   0,   0,   0,   0,   0,  0,   98,  134, 61,  95,  68,
+     126, 34,  -11, -6,  7,   26,  31,  65,  56,  25, -20, -14, 13,
+     6,   21,  23,  12,  17,  -23, -27, -2,  -5,  12, 17,  6,   10,
+     -25, -26, -4,  -4,  -10, 3,   3,   33,  -12, -35, -1, -20, -23,
+     -15, 24,  38,  -22, 0,   0,   0,   0,   0,   0,   0,  0},
+    // knight
+    {-167, -89, -34, -49, 61,  -97, -15, -107, -73, -41, 72,  36,  23,
+     62,   7,   -17, -47, 60,  37,  65,  84,   129, 73,  44,  -9,  17,
+     19,   53,  37,  69,  18,  22,  -13, 4,    16,  13,  28,  19,  21,
+     -8,   -23, -9,  12,  10,  19,  17,  25,   -16, -29, -53, -12, -3,
+     -1,   18,  -14, -19, -105, -21, -58, -33, -17,  -28, -19, -23},
+    // bishop
+    {-29, 4,   -82, -37, -25, -42, 7,   -8,  -26, 16,  -18, -13, 30,
+     59,  18,  -47, -16, 37,  43,  40,  35,  50,  37,  -2,  -4,  5,
+     19,  50,  37,  37,  7,   -2,  -6,  13,  13,  26,  34,  12,  10,
+     4,   0,   15,  15,  15,  14,  27,  18,  10,  4,   15,  16,  0,
+     7,   21,  33,  1,   -33, -3,  -14, -21, -13, -12, -39, -21},
+    // rook
+    {32,  42,  32,  51,  63,  9,   31,  43,  27,  32,  58,  62,  80,
+     67,  26,  44,  -5,  19,  26,  36,  17,  45,  61,  16,  -24, -11,
+     7,   26,  24,  35,  -8,  -20, -36, -26, -12, -1,  9,   -7,  6,
+     -23, -45, -25, -16, -17, 3,   0,   -5,  -33, -44, -16, -20, -9,
+     -1,  11,  -6,  -71, -19, -13, 1,   17,  16,  7,   -37, -26},
+    // queen
+    {-28, 0,   29,  12,  59,  44,  43,  45,  -24, -39, -5,  1,   -16,
+     57,  28,  54,  -13, -17, 7,   8,   29,  56,  47,  57,  -27, -27,
+     -16, -16, -1,  17,  -2,  1,   -9,  -26, -9,  -10, -2,  -4,  3,
+     -3,  -14, 2,   -11, -2,  -5,  2,   14,  5,   -35, -8,  11,  2,
+     8,   15,  -3,  1,   -1,  -18, -9,  10,  -15, -25, -31, -50},
+    // king
+    {-65, 23,  16,  -15, -56, -34, 2,   13,  29,  -1,  -20, -7,  -8,
+     -4,  -38, -29, -9,  24,  2,   -16, -20, 6,   22,  -22, -17, -20,
+     -12, -27, -30, -25, -14, -36, -49, -1,  -27, -39, -46, -44, -33,
+     -51, -14, -14, -22, -46, -44, -30, -15, -27, 1,   7,   -8,  -64,
+     -43, -16, 9,   8,   -15, 36,  12,  -54, 8,   -28, 24,  14},
+};
+
+constexpr int eg_tables[6][64] = {
+    // pawn
+    {0,   0,   0,   0,   0,   0,   0,   0,   178, 173, 158, 134, 147,
+     132, 165, 187, 94,  100, 85,  67,  56,  53,  82,  84,  32,  24,
+     13,  5,   -2,  4,   17,  17,  13,  9,   -3,  -7,  -7,  -8,  3,
+     -1,  4,   7,   -6,  1,   0,   -5,  -1,  -8,  13,  8,   8,   10,
+     13,  0,   2,   -7,  0,   0,   0,   0,   0,   0,   0,   0},
+    // knight
+    {-58, -38, -13, -28, -31, -27, -63, -99, -25, -8,  -25, -2,  -9,
+     -25, -24, -52, -24, -20, 10,  9,   -1,  -9,  -19, -41, -17, 3,
+     22,  22,  22,  11,  8,   -18, -18, -6,  16,  25,  16,  17,  4,
+     -18, -23, -3,  -1,  15,  10,  -3,  -20, -22, -42, -20, -10, -5,
+     -2,  -20, -23, -44, -29, -51, -23, -15, -22, -18, -50, -64},
+    // bishop
+    {-14, -21, -11, -8,  -7,  -9,  -17, -24, -8,  -4,  7,   -12, -3,
+     -13, -4,  -14, 2,   -8,  0,   -1,  -2,  6,   0,   4,   -3,  9,
+     12,  9,   14,  10,  3,   2,   -6,  3,   13,  19,  7,   10,  -3,
+     -9,  -12, -3,  8,   10,  13,  3,   -7,  -15, -14, -18, -7,  -1,
+     4,   -9,  -15, -27, -23, -9,  -23, -5,  -9,  -16, -5,  -17},
+    // rook
+    {13,  10,  18,  15,  12,  12,  8,   5,   11,  13,  13,  11,  -3,
+     3,   8,   3,   7,   7,   7,   5,   4,   -3,  -5,  -3,  4,   3,
+     13,  1,   2,   1,   -1,  2,   3,   5,   8,   4,   -5,  -6,  -8,
+     -11, -4,  0,   -5,  -1,  -7,  -12, -8,  -16, -6,  -6,  0,   2,
+     -9,  -9,  -11, -3,  -9,  2,   3,   -1,  -5,  -13, 4,   -20},
+    // queen
+    {-9,  22,  22,  27,  27,  19,  10,  20,  -17, 20,  32,  41,  58,
+     25,  30,  0,   -20, 6,   9,   49,  47,  35,  19,  9,   3,   22,
+     24,  45,  57,  40,  57,  36,  -18, 28,  19,  47,  31,  34,  39,
+     23,  -16, -27, 15,  6,   9,   17,  10,  5,   -22, -23, -30, -16,
+     -16, -23, -36, -32, -33, -28, -22, -43, -5,  -32, -20, -41},
+    // king
+    {-74, -35, -18, -18, -11, 15,  4,   -17, -12, 17,  14,  17,  17,
+     38,  23,  11,  10,  17,  23,  15,  20,  45,  44,  13,  -8,  22,
+     24,  27,  26,  33,  26,  3,   -18, -4,  21,  24,  27,  23,  9,
+     -11, -19, -3,  11,  21,  23,  16,  7,   -9,  -27, -11, 4,   13,
+     14,  4,   -5,  -17, -53, -34, -21, -11, -28, -14, -24, -43},
+};
+
+constexpr PieceSquareTables make_piece_square_tables() {
+    PieceSquareTables tables{};
+    for (int type = Pawn; type <= King; type++) {
+        for (int square = 0; square < 64; square++) {
+            tables.mg[0][type][square] =
+                mg_values[type] + mg_tables[type][square ^ 56];
+            tables.eg[0][type][square] =
+                eg_values[type] + eg_tables[type][square ^ 56];
+            tables.mg[1][type][square] =
+                -(mg_values[type] + mg_tables[type][square]);
+            tables.eg[1][type][square] =
+                -(eg_values[type] + eg_tables[type][square]);
+        }
+    }
+    return tables;
+}
+
+// pawn structure, indexed by the pawn's rank counted from its own side
+const int doubled_mg = -10;
+const int doubled_eg = -20;
+const int isolated_mg = -10;
+const int isolated_eg = -15;
+const int passed_mg[8] = {0, 0, 5, 10, 20, 35, 60, 0};
+const int passed_eg[8] = {0, 10, 15, 25, 45, 75, 120, 0};
+
+// knights and bishops on the opponent's side defended by a pawn where no
+// enemy pawn can ever attack them, pawn to king
+const int outpost_mg[6] = {0, 20, 10, 0, 0, 0};
+const int outpost_eg[6] = {0, 10, 5, 0, 0, 0};
+const uint64_t outpost_ranks[2] = {0xFFFFFFULL << 24, 0xFFFFFFULL << 16};
+
+// king safety, applied to the middlegame score only
+const int missing_shield_mg = -15;
+// attack units per king zone square a piece attacks, pawn to king
+const int attack_weights[6] = {0, 2, 2, 3, 5, 0};
+const int max_king_danger = 400;
+
+struct PawnMasks {
+    uint64_t files[8];
+    uint64_t adjacent_files[8];
+    // squares in front of a pawn on its own and adjacent files
+    uint64_t passed[2][64];
+};
+
+constexpr PawnMasks make_pawn_masks() {
+    PawnMasks masks{};
+    for (int file = 0; file < 8; file++) {
+        masks.files[file] = file_a << file;
+    }
+    for (int file = 0; file < 8; file++) {
+        masks.adjacent_files[file] =
+            (file > 0 ? masks.files[file - 1] : 0) |
+            (file < 7 ? masks.files[file + 1] : 0);
+    }
+    for (int square = 0; square < 64; square++) {
+        int file = square % 8;
+        int rank = square / 8;
+        uint64_t span = masks.files[file] | masks.adjacent_files[file];
+        for (int r = 0; r < 8; r++) {
+            uint64_t row = span & (rank_1 << (8 * r));
+            if (r > rank) {
+                masks.passed[0][square] |= row;
+            }
+            if (r < rank) {
+                masks.passed[1][square] |= row;
+            }
+        }
+    }
+    return masks;
+}
+
+constexpr PawnMasks pawn_masks = make_pawn_masks();
+
+int evaluate_king_safety(const ChessBoard &board, int color) {
+    Player us = static_cast<Player>(color);
+    Player them = static_cast<Player>(color ^ 1);
+    int king = board.pieces(us, King).getLSB();
+    int file = king % 8;
+    int rank = color == 0 ? king / 8 : 7 - king / 8;
+    int score = 0;
+
+    // pawns on the two ranks in front of a king still near its back rank
+    if (rank <= 1) {
+        uint64_t front = color == 0 ? 0xFFFFULL << (8 * (king / 8 + 1))
+                                    : 0xFFFFULL << (8 * (king / 8 - 2));
+        Bitboard shield = board.pieces(us, Pawn) & Bitboard(front);
+        for (int f = std::max(file - 1, 0); f <= std::min(file + 1, 7); f++) {
+            if ((shield & Bitboard(pawn_masks.files[f])).empty()) {
+                score += missing_shield_mg;
+            }
+        }
+    }
+
+    Bitboard zone = king_attacks[king];
+    zone.set(king);
+    Bitboard occupancy = board.all_pieces_;
+    int attackers = 0;
+    int units = 0;
+    for (int type = Knight; type <= Queen; type++) {
+        for (auto from : board.pieces(them, static_cast<PieceType>(type))) {
+            int square = from.square_;
+            Bitboard attacks;
+            switch (type) {
+            case Knight:
+                attacks = knight_attacks[square];
+                break;
+            case Bishop:
+                attacks = generate_bishop_moves(from, occupancy);
+                break;
+            case Rook:
+                attacks = generate_rook_moves(from, occupancy);
+                break;
+            default:
+                attacks = generate_queen_moves(from, occupancy);
+                break;
+            }
+            int count = (attacks & zone).count();
+            if (count > 0) {
+                attackers++;
+                units += attack_weights[type] * count;
+            }
+        }
+    }
+    // a lone attacker is rarely dangerous
+    if (attackers >= 2) {
+        score -= std::min(units * units / 2, max_king_danger);
+    }
+    return score;
+}
+
+void evaluate_outposts(const ChessBoard &board, const PawnEntry &pawns,
+                       int &mg, int &eg) {
+    for (int color = 0; color < 2; color++) {
+        int sign = color == 0 ? 1 : -1;
+        Bitboard ours = board.pieces(static_cast<Player>(color), Pawn);
+        Bitboard defended =
+            color == 0
+                ? white_pawn_captures_west(ours) | white_pawn_captures_east(ours)
+                : black_pawn_captures_west(ours) |
+                      black_pawn_captures_east(ours);
+        Bitboard outposts = defended & ~pawns.attack_spans[color ^ 1] &
+                            Bitboard(outpost_ranks[color]);
+        for (int type = Knight; type <= Bishop; type++) {
+            int count = (board.pieces(static_cast<Player>(color),
+                                      static_cast<PieceType>(type)) &
+                         outposts)
+                            .count();
+            mg += sign * outpost_mg[type] * count;
+            eg += sign * outpost_eg[type] * count;
+        }
+    }
+}
+
+#ifndef NDEBUG
+bool piece_square_sums_match(const ChessBoard &board) {
+    int mg = 0, eg = 0, phase = 0;
+    for (int color = 0; color < 2; color++) {
+        for (int type = Pawn; type <= King; type++) {
+            for (auto square : board.colored_pieces_[color][type]) {
+                mg += piece_square_tables.mg[color][type][square.square_];
+                eg += piece_square_tables.eg[color][type][square.square_];
+                phase += phase_weights[type];
+            }
+        }
+    }
+    return mg == board.mg_score_ && eg == board.eg_score_ &&
+           phase == board.phase_;
+}
+#endif
+
+} // namespace
+
+const PieceSquareTables piece_square_tables = make_piece_square_tables();
+const int phase_weights[6] = {0, 1, 1, 2, 4, 0};
+
+void evaluate_pawns(const ChessBoard &board, PawnEntry &entry) {
+    int mg = 0;
+    int eg = 0;
+    for (int color = 0; color < 2; color++) {
+        int sign = color == 0 ? 1 : -1;
+        Bitboard ours = board.pieces(static_cast<Player>(color), Pawn);
+        Bitboard theirs = board.pieces(static_cast<Player>(color ^ 1), Pawn);
+
+        for (int file = 0; file < 8; file++) {
+            int count = (ours & Bitboard(pawn_masks.files[file])).count();
+            if (count == 0) {
+                continue;
+            }
+            if (count > 1) {
+                mg += sign * doubled_mg * (count - 1);
+                eg += sign * doubled_eg * (count - 1);
+            }
+            if ((ours & Bitboard(pawn_masks.adjacent_files[file])).empty()) {
+                mg += sign * isolated_mg * count;
+                eg += sign * isolated_eg * count;
+            }
+        }
+
+        for (auto pawn : ours) {
+            int square = pawn.square_;
+            if ((theirs & Bitboard(pawn_masks.passed[color][square])).empty()) {
+                int rank = color == 0 ? square / 8 : 7 - square / 8;
+                mg += sign * passed_mg[rank];
+                eg += sign * passed_eg[rank];
+            }
+        }
+    }
+    entry.mg = mg;
+    entry.eg = eg;
+
+    // fill each color's pawns towards the opponent and take their captures
+    Bitboard white = board.pieces(Player::White, Pawn);
+    Bitboard black = board.pieces(Player::Black, Pawn);
+    white |= white << 8;
+    white |= white << 16;
+    white |= white << 32;
+    black |= black >> 8;
+    black |= black >> 16;
+    black |= black >> 32;
+    entry.attack_spans[0] =
+        white_pawn_captures_west(white) | white_pawn_captures_east(white);
+    entry.attack_spans[1] =
+        black_pawn_captures_west(black) | black_pawn_captures_east(black);
+}
+
+int evaluate_classical(const ChessBoard &board, PawnTable *pawn_table) {
+    assert(piece_square_sums_match(board));
+
+    PawnEntry local;
+    PawnEntry *pawns = &local;
+    if (!pawn_table || !pawn_table->probe(board.pawn_hash_, pawns)) {
+        evaluate_pawns(board, *pawns);
+        pawns->key = board.pawn_hash_;
+    }
+
+    // material and piece-square sums are kept by the board as pieces move
+    int mg = board.mg_score_ + pawns->mg;
+    int eg = board.eg_score_ + pawns->eg;
+    mg += evaluate_king_safety(board, 0) - evaluate_king_safety(board, 1);
+    evaluate_outposts(board, *pawns, mg, eg);
+
+    int phase = std::min(board.phase_, max_phase);
+    int score = (mg * phase + eg * (max_phase - phase)) / max_phase;
+    return board.player_ == Player::White ? score : -score;
+}
+
+int evaluate(const ChessBoard &board, PawnTable *pawn_table) {
+    if (network_loaded()) {
+        // keep network scores well clear of mate scores
+        return std::clamp(evaluate_nnue(board), -max_evaluation,
+                          max_evaluation);
+    }
+    return evaluate_classical(board, pawn_table);
+}
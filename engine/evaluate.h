@@ -0,0 +1,28 @@
+#pragma once
+
+#include "chessboard.h"
+#include "pawn_table.h"
+
+// material plus piece-square value of each color, piece and square for the
+// middlegame and endgame, from white's point of view so black's are negative
+struct PieceSquareTables {
+    int mg[2][6][64];
+    int eg[2][6][64];
+};
+
+extern const PieceSquareTables piece_square_tables;
+// game phase each piece type adds, the phase starts at max_phase
+extern const int phase_weights[6];
+const int max_phase = 24;
+const int max_evaluation = 10000;
+
+// fill in the pawn structure terms of the board's pawns, but not the key
+void evaluate_pawns(const ChessBoard &board, PawnEntry &entry);
+
+// hand written evaluation in centipawns from the side to move's point of
+// view, pawn structure is cached in pawn_table if one is given
+int evaluate_classical(const ChessBoard &board,
+                       PawnTable *pawn_table = nullptr);
+
+// the network's evaluation when one is loaded, the classical one otherwise
+int evaluate(const ChessBoard &board, PawnTable *pawn_table = nullptr);
@@ -0,0 +1,200 @@
+#include "log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+std::atomic<LogLevel> log_level(LogLevel::Info);
+
+namespace {
+
+const int ring_size = 256;
+const std::chrono::milliseconds writer_interval(5);
+const char *level_names[] = {"DEBUG", "INFO", "WARNING", "ERROR"};
+
+struct LogRecord {
+    LogLevel level;
+    int64_t time_us;
+    int length;
+    char text[max_log_length];
+};
+
+// single producer single consumer queue of one logging thread, head is only
+// written by that thread and tail only by the writer
+struct LogRing {
+    LogRecord records[ring_size];
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::atomic<uint64_t> dropped{0};
+    // set when the thread exits, the writer frees the ring once drained
+    std::atomic<bool> retired{false};
+    int thread = 0;
+};
+
+int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+void format_record(const LogRecord &record, int thread, std::string &out) {
+    time_t seconds = record.time_us / 1000000;
+    tm local;
+    localtime_r(&seconds, &local);
+    char prefix[64];
+    size_t length = strftime(prefix, sizeof(prefix), "%F %T", &local);
+    snprintf(prefix + length, sizeof(prefix) - length, ".%03d %s [%d] ",
+             static_cast<int>(record.time_us / 1000 % 1000),
+             level_names[static_cast<int>(record.level)], thread);
+    out += prefix;
+    out.append(record.text, record.length);
+    out += '\n';
+}
+
+// owns every ring and the background thread that drains them
+class LogWriter {
+  public:
+    LogWriter() : thread_([this]() { run(); }) {}
+
+    ~LogWriter() {
+        stop_ = true;
+        thread_.join();
+    }
+
+    LogRing *add_ring() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.push_back(std::make_unique<LogRing>());
+        rings_.back()->thread = next_thread_++;
+        return rings_.back().get();
+    }
+
+    void flush() {
+        // a pass that starts after this call drains everything queued so far
+        uint64_t target = passes_.load() + 2;
+        while (passes_.load() < target) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+  private:
+    void run() {
+        while (!stop_.load()) {
+            drain();
+            std::this_thread::sleep_for(writer_interval);
+        }
+        drain();
+    }
+
+    void drain() {
+        std::string out;
+        std::string err;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t i = 0; i < rings_.size(); i++) {
+                LogRing &ring = *rings_[i];
+                bool retired = ring.retired.load(std::memory_order_acquire);
+                uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+                uint64_t head = ring.head.load(std::memory_order_acquire);
+                for (; tail < head; tail++) {
+                    const LogRecord &record = ring.records[tail % ring_size];
+                    format_record(record, ring.thread,
+                                  record.level >= LogLevel::Warning ? err
+                                                                    : out);
+                }
+                ring.tail.store(tail, std::memory_order_release);
+
+                uint64_t dropped = ring.dropped.exchange(0);
+                if (dropped > 0) {
+                    err += "dropped " + std::to_string(dropped) +
+                           " log messages from thread " +
+                           std::to_string(ring.thread) + "\n";
+                }
+                if (retired) {
+                    rings_.erase(rings_.begin() + i--);
+                }
+            }
+        }
+
+        if (!out.empty()) {
+            fwrite(out.data(), 1, out.size(), stdout);
+            fflush(stdout);
+        }
+        if (!err.empty()) {
+            fwrite(err.data(), 1, err.size(), stderr);
+            fflush(stderr);
+        }
+        passes_++;
+    }
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<LogRing>> rings_;
+    int next_thread_ = 0;
+    std::atomic<bool> stop_{false};
+    std::atomic<uint64_t> passes_{0};
+    std::thread thread_;
+};
+
+LogWriter &writer() {
+    static LogWriter instance;
+    return instance;
+}
+
+// marks the thread's ring retired when the thread exits
+struct RingHandle {
+    LogRing *ring = nullptr;
+
+    ~RingHandle() {
+        if (ring) {
+            ring->retired.store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local RingHandle ring_handle;
+
+} // namespace
+
+void set_log_level(LogLevel level) { log_level.store(level); }
+
+bool parse_log_level(const std::string &name, LogLevel &level) {
+    const char *names[] = {"debug", "info", "warning", "error", "off"};
+    for (int i = 0; i <= static_cast<int>(LogLevel::Off); i++) {
+        if (name == names[i]) {
+            level = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void log_message(LogLevel level, const std::string &message) {
+    if (!log_enabled(level) || level == LogLevel::Off) {
+        return;
+    }
+    if (!ring_handle.ring) {
+        ring_handle.ring = writer().add_ring();
+    }
+
+    LogRing &ring = *ring_handle.ring;
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) == ring_size) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    LogRecord &record = ring.records[head % ring_size];
+    record.level = level;
+    record.time_us = now_us();
+    record.length =
+        std::min(message.size(), static_cast<size_t>(max_log_length));
+    std::memcpy(record.text, message.data(), record.length);
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void flush_log() { writer().flush(); }
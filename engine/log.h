@@ -0,0 +1,28 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+enum class LogLevel { Debug, Info, Warning, Error, Off };
+
+// messages longer than this are truncated
+const int max_log_length = 512;
+
+extern std::atomic<LogLevel> log_level;
+
+inline bool log_enabled(LogLevel level) {
+    return level >= log_level.load(std::memory_order_relaxed);
+}
+
+void set_log_level(LogLevel level);
+// parse "debug", "info", "warning", "error" or "off", false if unknown
+bool parse_log_level(const std::string &name, LogLevel &level);
+
+// queue a message on the calling thread's ring buffer without blocking. a
+// background thread writes it to stderr for warnings and errors and to
+// stdout otherwise, messages are dropped and counted when a ring is full.
+// check log_enabled() first when the message is costly to build.
+void log_message(LogLevel level, const std::string &message);
+
+// wait until every message queued so far has been written
+void flush_log();
@@ -2,6 +2,9 @@
 
 #include "square.h"
 
+#include <cstdint>
+#include <string>
+
 const std::string chess_positions[] = {
     "a1", "b1", "c1", "d1", "e1", "f1", "g1", "h1", "a2", "b2", "c2",
     "d2", "e2", "f2", "g2", "h2", "a3", "b3", "c3", "d3", "e3", "f3",
@@ -10,27 +13,102 @@ const std::string chess_positions[] = {
     "e6", "f6", "g6", "h6", "a7", "b7", "c7", "d7", "e7", "f7", "g7",
     "h7", "a8", "b8", "c8", "d8", "e8", "f8", "g8", "h8"};
 
+// a move packed into 16 bits: from square in bits 0-5, to square in bits
+// 6-11 and the promotion piece in bits 12-14 (0 if none)
 class Move {
   public:
+    Move() : data_(0) {}
+    Move(int from, int to, char promotion = '\0')
+        : data_(from | (to << 6) | (promotion_code(promotion) << 12)) {}
     Move(Square from, Square to, char promotion = '\0')
-        : from_(from), to_(to), promotion_(promotion) {}
-    Move(std::string move)
-        : from_(move.substr(0, 2)), to_(move.substr(2, 2)), promotion_('\0') {
-        if (move.size() == 5) {
-            promotion_ = move[4];
+        : Move(from.square_, to.square_, promotion) {}
+    // long algebraic notation, e.g. e2e4 or e7e8q. malformed strings give
+    // the null move, which is never legal
+    Move(const std::string &move) : data_(0) {
+        if (move.size() < 4 || move.size() > 5) {
+            return;
+        }
+        int from = parse_square(move[0], move[1]);
+        int to = parse_square(move[2], move[3]);
+        int promotion = move.size() == 5 ? promotion_code(move[4]) : 0;
+        if (from < 0 || to < 0 || (move.size() == 5 && promotion == 0)) {
+            return;
         }
+        data_ = from | (to << 6) | (promotion << 12);
+    }
+
+    inline int from() const { return data_ & 0x3F; }
+    inline int to() const { return (data_ >> 6) & 0x3F; }
+    inline char promotion() const { return "\0nbrq"[(data_ >> 12) & 0x7]; }
+    inline uint16_t raw() const { return data_; }
+
+    static Move from_raw(uint16_t data) {
+        Move move;
+        move.data_ = data;
+        return move;
     }
 
     std::string to_string() const {
-        std::string move =
-            chess_positions[from_.square_] + chess_positions[to_.square_];
-        if (promotion_ != '\0') {
-            move += promotion_;
+        std::string move = chess_positions[from()] + chess_positions[to()];
+        if (promotion() != '\0') {
+            move += promotion();
         }
         return move;
     }
 
-    Square from_;
-    Square to_;
-    char promotion_;
-};
\ No newline at end of file
+    friend bool operator==(const Move &lhs, const Move &rhs) {
+        return lhs.data_ == rhs.data_;
+    }
+
+    friend bool operator!=(const Move &lhs, const Move &rhs) {
+        return !(lhs == rhs);
+    }
+
+  private:
+    static int promotion_code(char promotion) {
+        switch (promotion) {
+        case 'n':
+            return 1;
+        case 'b':
+            return 2;
+        case 'r':
+            return 3;
+        case 'q':
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
+    static int parse_square(char file, char rank) {
+        if (file < 'a' || file > 'h' || rank < '1' || rank > '8') {
+            return -1;
+        }
+        return (rank - '1') * 8 + (file - 'a');
+    }
+
+    uint16_t data_;
+};
+
+const int max_moves = 256;
+
+// fixed-capacity move buffer filled by the legal move generator
+class MoveList {
+  public:
+    inline void push_back(const Move &move) { moves_[size_++] = move; }
+    inline void clear() { size_ = 0; }
+    inline int size() const { return size_; }
+    inline bool empty() const { return size_ == 0; }
+
+    inline Move &operator[](int i) { return moves_[i]; }
+    inline const Move &operator[](int i) const { return moves_[i]; }
+
+    Move *begin() { return moves_; }
+    Move *end() { return moves_ + size_; }
+    const Move *begin() const { return moves_; }
+    const Move *end() const { return moves_ + size_; }
+
+  private:
+    Move moves_[max_moves];
+    int size_ = 0;
+};
@@ -9,14 +9,35 @@ extern const Bitboard knight_attacks[64];
 extern const Bitboard king_attacks[64];
 extern const Bitboard bishop_masks[64];
 extern const Bitboard rook_masks[64];
-extern Bitboard bishop_table[64][1024];
-extern Bitboard rook_table[64][4096];
+extern const uint64_t rook_magic_numbers[64];
+extern const uint64_t bishop_magic_numbers[64];
 extern const int rook_shift_bits[64];
 extern const int bishop_shift_bits[64];
 
-uint64_t get_blocker(int index, Bitboard mask);
+// every square's attack sets for all blocker subsets packed back to back,
+// 5248 bishop entries then 102400 rook entries
+const int slider_attacks_size = 107648;
 
-void init_sliding_moves();
+// generated at build time by generate_tables. each square's attacks start
+// at its offset, indexed by the magic key or by pext of the blockers
+extern const int bishop_offsets[64];
+extern const int rook_offsets[64];
+extern const Bitboard magic_attacks[slider_attacks_size];
+extern const Bitboard pext_attacks[slider_attacks_size];
+// squares strictly between two squares on a shared rank, file or diagonal
+extern const Bitboard between_squares[64][64];
+
+// the blocker subset of mask selected by the bits of index
+uint64_t get_blockers(int index, Bitboard mask);
+
+enum class SliderIndexing { Magic, Pext };
+
+// true if the cpu has bmi2 pext
+bool pext_supported();
+// pext is picked at startup when supported. returns the indexing in use,
+// which stays magic if pext was asked for but is unsupported
+SliderIndexing set_slider_indexing(SliderIndexing indexing);
+SliderIndexing get_slider_indexing();
 
 Bitboard generate_white_pawn_moves(Square from, Bitboard all_pieces,
                                    Bitboard capture_pieces);
@@ -24,6 +45,49 @@ Bitboard generate_white_pawn_moves(Square from, Bitboard all_pieces,
 Bitboard generate_black_pawn_moves(Square from, Bitboard all_pieces,
                                    Bitboard capture_pieces);
 
+const uint64_t file_a = 0x0101010101010101ULL;
+const uint64_t file_h = 0x8080808080808080ULL;
+const uint64_t rank_1 = 0xFFULL;
+const uint64_t rank_3 = 0xFFULL << 16;
+const uint64_t rank_6 = 0xFFULL << 40;
+const uint64_t rank_8 = 0xFFULL << 56;
+
+// set-wise pawn targets: each takes every pawn of one color at once and
+// returns the squares they reach, captures towards the a and h files
+inline Bitboard white_pawn_pushes(Bitboard pawns, Bitboard empty) {
+    return (pawns << 8) & empty;
+}
+
+inline Bitboard white_pawn_double_pushes(Bitboard pawns, Bitboard empty) {
+    return ((white_pawn_pushes(pawns, empty) & Bitboard(rank_3)) << 8) &
+           empty;
+}
+
+inline Bitboard white_pawn_captures_west(Bitboard pawns) {
+    return (pawns & Bitboard(~file_a)) << 7;
+}
+
+inline Bitboard white_pawn_captures_east(Bitboard pawns) {
+    return (pawns & Bitboard(~file_h)) << 9;
+}
+
+inline Bitboard black_pawn_pushes(Bitboard pawns, Bitboard empty) {
+    return (pawns >> 8) & empty;
+}
+
+inline Bitboard black_pawn_double_pushes(Bitboard pawns, Bitboard empty) {
+    return ((black_pawn_pushes(pawns, empty) & Bitboard(rank_6)) >> 8) &
+           empty;
+}
+
+inline Bitboard black_pawn_captures_west(Bitboard pawns) {
+    return (pawns & Bitboard(~file_a)) >> 9;
+}
+
+inline Bitboard black_pawn_captures_east(Bitboard pawns) {
+    return (pawns & Bitboard(~file_h)) >> 7;
+}
+
 Bitboard generate_knight_moves(Square from);
 
 Bitboard generate_king_moves(Square from);
@@ -0,0 +1,308 @@
+#include "nnue.h"
+#include "chessboard.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// network file layout, every value little-endian:
+//   8 byte magic "ACNNUE01"
+//   int16 feature_biases[256], int16 feature_weights[40960][256]
+//   int32 layer1_biases[32], int8 layer1_weights[32][512]
+//   int32 layer2_biases[32], int8 layer2_weights[32][32]
+//   int32 output_bias, int8 output_weights[32]
+// layer inputs are clipped to [0, 127] and layer sums are scaled down by 64
+// before clipping, the output is scaled down by 16 to centipawns.
+
+namespace {
+
+const char network_magic[8] = {'A', 'C', 'N', 'N', 'U', 'E', '0', '1'};
+const int layer_shift = 6;
+const int output_scale = 16;
+
+struct NnueNetwork {
+    alignas(32) int16_t feature_biases[nnue_hidden];
+    alignas(32) int16_t feature_weights[nnue_features][nnue_hidden];
+    int32_t layer1_biases[nnue_layer1];
+    alignas(32) int8_t layer1_weights[nnue_layer1][2 * nnue_hidden];
+    int32_t layer2_biases[nnue_layer2];
+    alignas(32) int8_t layer2_weights[nnue_layer2][nnue_layer1];
+    int32_t output_bias;
+    int8_t output_weights[nnue_layer2];
+};
+
+std::unique_ptr<NnueNetwork> network;
+
+template <typename T> bool read(FILE *file, T *values, size_t count) {
+    return fread(values, sizeof(T), count, file) == count;
+}
+
+// feature of a piece seen from perspective's side, squares are flipped for
+// black so both sides see their own pieces from the bottom of the board
+inline int feature_index(int perspective, int king, int color, int type,
+                         int square) {
+    int flip = perspective == 0 ? 0 : 56;
+    int kind = type + (color == perspective ? 0 : 5);
+    return (((king ^ flip) * 10 + kind) << 6) + (square ^ flip);
+}
+
+inline uint8_t clip(int value) {
+    return static_cast<uint8_t>(std::clamp(value, 0, 127));
+}
+
+void add_feature_scalar(int16_t *values, const int16_t *weights) {
+    for (int i = 0; i < nnue_hidden; i++) {
+        values[i] += weights[i];
+    }
+}
+
+void sub_feature_scalar(int16_t *values, const int16_t *weights) {
+    for (int i = 0; i < nnue_hidden; i++) {
+        values[i] -= weights[i];
+    }
+}
+
+// clipped relu of weights * input + biases, inputs is a multiple of 32
+void dense_scalar(const uint8_t *input, int inputs, const int8_t *weights,
+                  const int32_t *biases, int outputs, uint8_t *output) {
+    for (int j = 0; j < outputs; j++) {
+        int sum = biases[j];
+        for (int i = 0; i < inputs; i++) {
+            sum += weights[j * inputs + i] * input[i];
+        }
+        output[j] = clip(sum >> layer_shift);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_AVX2 1
+__attribute__((target("avx2"))) void add_feature_avx2(int16_t *values,
+                                                      const int16_t *weights) {
+    for (int i = 0; i < nnue_hidden; i += 16) {
+        __m256i *v = reinterpret_cast<__m256i *>(values + i);
+        __m256i w =
+            _mm256_load_si256(reinterpret_cast<const __m256i *>(weights + i));
+        _mm256_store_si256(v, _mm256_add_epi16(_mm256_load_si256(v), w));
+    }
+}
+
+__attribute__((target("avx2"))) void sub_feature_avx2(int16_t *values,
+                                                      const int16_t *weights) {
+    for (int i = 0; i < nnue_hidden; i += 16) {
+        __m256i *v = reinterpret_cast<__m256i *>(values + i);
+        __m256i w =
+            _mm256_load_si256(reinterpret_cast<const __m256i *>(weights + i));
+        _mm256_store_si256(v, _mm256_sub_epi16(_mm256_load_si256(v), w));
+    }
+}
+
+// the u8 * i8 pair sums of maddubs cannot saturate since inputs are at most
+// 127, so this matches dense_scalar exactly
+__attribute__((target("avx2"))) void
+dense_avx2(const uint8_t *input, int inputs, const int8_t *weights,
+           const int32_t *biases, int outputs, uint8_t *output) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    for (int j = 0; j < outputs; j++) {
+        __m256i sum = _mm256_setzero_si256();
+        for (int i = 0; i < inputs; i += 32) {
+            __m256i in =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input + i));
+            __m256i w = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i *>(weights + j * inputs + i));
+            sum = _mm256_add_epi32(
+                sum, _mm256_madd_epi16(_mm256_maddubs_epi16(in, w), ones));
+        }
+        __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                                     _mm256_extracti128_si256(sum, 1));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+        output[j] = clip((biases[j] + _mm_cvtsi128_si32(half)) >> layer_shift);
+    }
+}
+#else
+#define HAVE_AVX2 0
+#endif
+
+bool use_avx2 = avx2_supported();
+
+void add_feature(int16_t *values, int feature) {
+    const int16_t *weights = network->feature_weights[feature];
+#if HAVE_AVX2
+    if (use_avx2) {
+        add_feature_avx2(values, weights);
+        return;
+    }
+#endif
+    add_feature_scalar(values, weights);
+}
+
+void sub_feature(int16_t *values, int feature) {
+    const int16_t *weights = network->feature_weights[feature];
+#if HAVE_AVX2
+    if (use_avx2) {
+        sub_feature_avx2(values, weights);
+        return;
+    }
+#endif
+    sub_feature_scalar(values, weights);
+}
+
+void dense(const uint8_t *input, int inputs, const int8_t *weights,
+           const int32_t *biases, int outputs, uint8_t *output) {
+#if HAVE_AVX2
+    if (use_avx2) {
+        dense_avx2(input, inputs, weights, biases, outputs, output);
+        return;
+    }
+#endif
+    dense_scalar(input, inputs, weights, biases, outputs, output);
+}
+
+// build perspective's accumulator from every piece on the board
+void refresh(const ChessBoard &board, NnueAccumulator &accumulator,
+             int perspective) {
+    int16_t *values = accumulator.values[perspective];
+    int king = board.colored_pieces_[perspective][King].getLSB();
+    std::memcpy(values, network->feature_biases, sizeof(int16_t) * nnue_hidden);
+    for (int color = 0; color < 2; color++) {
+        for (int type = Pawn; type < King; type++) {
+            for (auto square : board.colored_pieces_[color][type]) {
+                add_feature(values, feature_index(perspective, king, color,
+                                                  type, square.square_));
+            }
+        }
+    }
+    accumulator.computed[perspective] = true;
+}
+
+// bring the current ply's accumulator up to date from the last computed one,
+// or refresh it when perspective's king moved since then
+void update(const ChessBoard &board, int perspective) {
+    auto &accumulators = board.accumulators_;
+    int ply = board.undo_stack_.size();
+    int computed = ply;
+    while (!accumulators[computed].computed[perspective]) {
+        const NnueAccumulator &accumulator = accumulators[computed];
+        bool king_moved = computed == 0;
+        for (int i = 0; i < accumulator.dirty_count; i++) {
+            king_moved |= accumulator.dirty[i].type == King &&
+                          accumulator.dirty[i].color == perspective;
+        }
+        if (king_moved) {
+            refresh(board, accumulators[ply], perspective);
+            return;
+        }
+        computed--;
+    }
+
+    int king = board.colored_pieces_[perspective][King].getLSB();
+    for (int i = computed + 1; i <= ply; i++) {
+        NnueAccumulator &accumulator = accumulators[i];
+        int16_t *values = accumulator.values[perspective];
+        std::memcpy(values, accumulators[i - 1].values[perspective],
+                    sizeof(int16_t) * nnue_hidden);
+        for (int j = 0; j < accumulator.dirty_count; j++) {
+            const DirtyPiece &piece = accumulator.dirty[j];
+            if (piece.type == King) {
+                continue;
+            }
+            if (piece.from >= 0) {
+                sub_feature(values, feature_index(perspective, king,
+                                                  piece.color, piece.type,
+                                                  piece.from));
+            }
+            if (piece.to >= 0) {
+                add_feature(values, feature_index(perspective, king,
+                                                  piece.color, piece.type,
+                                                  piece.to));
+            }
+        }
+        accumulator.computed[perspective] = true;
+    }
+}
+
+} // namespace
+
+void refresh_accumulators(const ChessBoard &board) {
+    if (network) {
+        update(board, 0);
+        update(board, 1);
+    }
+}
+
+bool avx2_supported() {
+#if HAVE_AVX2
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+bool set_nnue_avx2(bool enabled) {
+    use_avx2 = enabled && avx2_supported();
+    return use_avx2;
+}
+
+bool load_network(const std::string &path) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    auto loaded = std::unique_ptr<NnueNetwork>(new NnueNetwork);
+    char magic[sizeof(network_magic)];
+    bool ok =
+        read(file, magic, sizeof(magic)) &&
+        std::memcmp(magic, network_magic, sizeof(magic)) == 0 &&
+        read(file, loaded->feature_biases, nnue_hidden) &&
+        read(file, &loaded->feature_weights[0][0],
+             static_cast<size_t>(nnue_features) * nnue_hidden) &&
+        read(file, loaded->layer1_biases, nnue_layer1) &&
+        read(file, &loaded->layer1_weights[0][0],
+             nnue_layer1 * 2 * nnue_hidden) &&
+        read(file, loaded->layer2_biases, nnue_layer2) &&
+        read(file, &loaded->layer2_weights[0][0], nnue_layer2 * nnue_layer1) &&
+        read(file, &loaded->output_bias, 1) &&
+        read(file, loaded->output_weights, nnue_layer2) &&
+        fgetc(file) == EOF;
+    fclose(file);
+
+    if (ok) {
+        network = std::move(loaded);
+    }
+    return ok;
+}
+
+bool network_loaded() { return network != nullptr; }
+
+int evaluate_nnue(const ChessBoard &board) {
+    update(board, 0);
+    update(board, 1);
+
+    const NnueAccumulator &accumulator =
+        board.accumulators_[board.undo_stack_.size()];
+    int us = board.player_ == Player::White ? 0 : 1;
+    alignas(32) uint8_t input[2 * nnue_hidden];
+    for (int i = 0; i < nnue_hidden; i++) {
+        input[i] = clip(accumulator.values[us][i]);
+        input[nnue_hidden + i] = clip(accumulator.values[us ^ 1][i]);
+    }
+
+    alignas(32) uint8_t layer1[nnue_layer1];
+    alignas(32) uint8_t layer2[nnue_layer2];
+    dense(input, 2 * nnue_hidden, &network->layer1_weights[0][0],
+          network->layer1_biases, nnue_layer1, layer1);
+    dense(layer1, nnue_layer1, &network->layer2_weights[0][0],
+          network->layer2_biases, nnue_layer2, layer2);
+
+    int output = network->output_bias;
+    for (int i = 0; i < nnue_layer2; i++) {
+        output += network->output_weights[i] * layer2[i];
+    }
+    return output / output_scale;
+}
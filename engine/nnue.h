@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+class ChessBoard;
+
+// HalfKP network: each side sees its own king square paired with every other
+// non-king piece, 64 king squares * 10 piece kinds * 64 squares. both sides'
+// accumulators feed two small clipped relu layers and a single output.
+const int nnue_features = 64 * 10 * 64;
+const int nnue_hidden = 256;
+const int nnue_layer1 = 32;
+const int nnue_layer2 = 32;
+
+// a piece added (from == -1), removed (to == -1) or moved by one move
+struct DirtyPiece {
+    int8_t color;
+    int8_t type;
+    int8_t from;
+    int8_t to;
+};
+
+// feature transformer output for both colors after one move, computed
+// lazily from the previous ply's accumulator and the pieces the move changed
+struct NnueAccumulator {
+    alignas(32) int16_t values[2][nnue_hidden];
+    bool computed[2] = {false, false};
+    DirtyPiece dirty[4];
+    int dirty_count = 0;
+
+    inline void add_dirty(int color, int type, int from, int to) {
+        dirty[dirty_count++] = {static_cast<int8_t>(color),
+                                static_cast<int8_t>(type),
+                                static_cast<int8_t>(from),
+                                static_cast<int8_t>(to)};
+    }
+};
+
+// load weights written in the layout described in nnue.cpp, returns false
+// and keeps the previous network if the file is missing or malformed
+bool load_network(const std::string &path);
+bool network_loaded();
+
+// avx2 is used when the cpu has it unless disabled, returns whether it is
+bool avx2_supported();
+bool set_nnue_avx2(bool enabled);
+
+// compute the current position's accumulators. a search calls it on its
+// root so evaluations below it update incrementally from there instead of
+// walking back through the game and refreshing from scratch.
+void refresh_accumulators(const ChessBoard &board);
+
+// network evaluation in centipawns from the side to move's point of view,
+// only valid once a network is loaded
+int evaluate_nnue(const ChessBoard &board);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "bitboard.h"
+
+#include <cstdint>
+#include <vector>
+
+// pawn structure terms of one pawn configuration, from white's point of view
+struct PawnEntry {
+    uint64_t key = 0;
+    int16_t mg = 0;
+    int16_t eg = 0;
+    // squares each color's pawns attack now or could attack by advancing
+    Bitboard attack_spans[2];
+};
+
+// cache of pawn structure terms keyed by the pawn hash. each search thread
+// owns one, so unlike the transposition table entries need no verification.
+// the empty entry is already correct for positions without pawns.
+class PawnTable {
+  public:
+    static const int size = 1 << 14;
+
+    PawnTable() : entries_(size) {}
+
+    // the slot for key, true if it already holds key's terms
+    inline bool probe(uint64_t key, PawnEntry *&entry) {
+        probes_++;
+        entry = &entries_[key & (size - 1)];
+        if (entry->key == key) {
+            hits_++;
+            return true;
+        }
+        return false;
+    }
+
+    uint64_t probes_ = 0;
+    uint64_t hits_ = 0;
+
+  private:
+    std::vector<PawnEntry> entries_;
+};
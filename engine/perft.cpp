@@ -0,0 +1,136 @@
+#include "perft.h"
+
+#include <thread>
+
+const std::vector<PerftPosition> perft_suite = {
+    {"startpos",
+     starting_fen,
+     {20, 400, 8902, 197281, 4865609, 119060324}},
+    {"kiwipete",
+     "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+     {48, 2039, 97862, 4085603, 193690690}},
+    {"position 3",
+     "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+     {14, 191, 2812, 43238, 674624, 11030083, 178633661}},
+    {"position 4",
+     "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+     {6, 264, 9467, 422333, 15833292}},
+    {"position 5",
+     "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+     {44, 1486, 62379, 2103487, 89941194}},
+    {"position 6",
+     "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 "
+     "10",
+     {46, 2079, 89890, 3894594, 164075551}},
+};
+
+PerftTable::PerftTable(size_t size_mb) {
+    // round down to a power of two so the index is a mask
+    size_t count = 1;
+    while (count * 2 * sizeof(Entry) <= size_mb * 1024 * 1024) {
+        count *= 2;
+    }
+    entries_ = std::make_unique<Entry[]>(count);
+    for (size_t i = 0; i < count; i++) {
+        entries_[i].key.store(0, std::memory_order_relaxed);
+        entries_[i].data.store(0, std::memory_order_relaxed);
+    }
+    mask_ = count - 1;
+}
+
+bool PerftTable::probe(uint64_t hash, int depth, uint64_t &nodes) const {
+    const Entry &entry = entries_[hash & mask_];
+    uint64_t key = entry.key.load(std::memory_order_relaxed);
+    uint64_t data = entry.data.load(std::memory_order_relaxed);
+
+    // low 8 bits hold the depth, the rest the node count
+    if ((key ^ data) != hash || static_cast<int>(data & 0xFF) != depth) {
+        return false;
+    }
+    nodes = data >> 8;
+    return true;
+}
+
+void PerftTable::store(uint64_t hash, int depth, uint64_t nodes) {
+    Entry &entry = entries_[hash & mask_];
+    uint64_t data = (nodes << 8) | static_cast<uint64_t>(depth);
+    entry.key.store(hash ^ data, std::memory_order_relaxed);
+    entry.data.store(data, std::memory_order_relaxed);
+}
+
+uint64_t perft(ChessBoard &board, int depth, PerftTable *table) {
+    if (depth == 0) {
+        return 1;
+    }
+
+    MoveList moves;
+    board.generate_legal_moves(moves);
+
+    // bulk count the last ply
+    if (depth == 1) {
+        return moves.size();
+    }
+
+    uint64_t nodes = 0;
+    if (table && table->probe(board.hash_, depth, nodes)) {
+        return nodes;
+    }
+
+    for (const auto &move : moves) {
+        board.make_move(move);
+        nodes += perft(board, depth - 1, table);
+        board.unmake_move();
+    }
+
+    if (table) {
+        table->store(board.hash_, depth, nodes);
+    }
+    return nodes;
+}
+
+uint64_t perft_parallel(const ChessBoard &board, int depth, int threads,
+                        PerftTable *table) {
+    if (depth <= 1 || threads <= 1) {
+        ChessBoard copy = board;
+        return perft(copy, depth, table);
+    }
+
+    MoveList moves;
+    board.generate_legal_moves(moves);
+
+    // threads take the next unclaimed root move until none are left
+    std::atomic<int> next_move(0);
+    std::atomic<uint64_t> nodes(0);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back([&]() {
+            ChessBoard copy = board;
+            uint64_t count = 0;
+            for (int j = next_move++; j < moves.size(); j = next_move++) {
+                copy.make_move(moves[j]);
+                count += perft(copy, depth - 1, table);
+                copy.unmake_move();
+            }
+            nodes += count;
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    return nodes;
+}
+
+std::vector<std::pair<Move, uint64_t>> divide(ChessBoard &board, int depth,
+                                              PerftTable *table) {
+    std::vector<std::pair<Move, uint64_t>> result;
+
+    MoveList moves;
+    board.generate_legal_moves(moves);
+    for (const auto &move : moves) {
+        board.make_move(move);
+        result.push_back({move, perft(board, depth - 1, table)});
+        board.unmake_move();
+    }
+    return result;
+}
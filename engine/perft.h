@@ -0,0 +1,53 @@
+#pragma once
+
+#include "chessboard.h"
+#include "move.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct PerftPosition {
+    std::string name;
+    std::string fen;
+    // expected leaf node counts for depth 1, 2, ...
+    std::vector<uint64_t> nodes;
+};
+
+// standard move generation test positions from the chess programming wiki
+extern const std::vector<PerftPosition> perft_suite;
+
+// lock-free subtree count cache shared by perft threads, keyed by the
+// zobrist hash and depth. each entry stores key ^ data next to data so a
+// torn write from a concurrent store fails verification instead of
+// returning a wrong count.
+class PerftTable {
+  public:
+    explicit PerftTable(size_t size_mb);
+
+    bool probe(uint64_t hash, int depth, uint64_t &nodes) const;
+    void store(uint64_t hash, int depth, uint64_t nodes);
+
+  private:
+    struct Entry {
+        std::atomic<uint64_t> key;
+        std::atomic<uint64_t> data;
+    };
+
+    std::unique_ptr<Entry[]> entries_;
+    size_t mask_;
+};
+
+// count leaf nodes of the legal move tree to the given depth
+uint64_t perft(ChessBoard &board, int depth, PerftTable *table = nullptr);
+
+// perft with the root moves split across threads
+uint64_t perft_parallel(const ChessBoard &board, int depth, int threads,
+                        PerftTable *table = nullptr);
+
+// perft split by root move
+std::vector<std::pair<Move, uint64_t>> divide(ChessBoard &board, int depth,
+                                              PerftTable *table = nullptr);
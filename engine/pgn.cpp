@@ -0,0 +1,447 @@
+#include "pgn.h"
+#include "engine.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+// games a replay worker takes from the reader at a time
+const size_t replay_batch_size = 64;
+
+bool is_result(const std::string &token) {
+    return token == "1-0" || token == "0-1" || token == "1/2-1/2" ||
+           token == "*";
+}
+
+void set_error(PgnGame &game, const std::string &error, size_t line) {
+    if (game.error.empty()) {
+        game.error = error;
+        game.error_line = line;
+    }
+}
+
+} // namespace
+
+MappedFile::~MappedFile() {
+    if (data_) {
+        munmap(const_cast<char *>(data_), size_);
+    }
+}
+
+bool MappedFile::open(const std::string &path) {
+    if (data_) {
+        munmap(const_cast<char *>(data_), size_);
+        data_ = nullptr;
+    }
+    size_ = 0;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1) {
+        close(fd);
+        return false;
+    }
+    if (info.st_size > 0) {
+        void *data =
+            mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        madvise(data, info.st_size, MADV_SEQUENTIAL);
+        data_ = static_cast<const char *>(data);
+        size_ = info.st_size;
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+    return true;
+}
+
+std::string PgnGame::tag(const std::string &name) const {
+    for (const auto &[key, value] : tags) {
+        if (key == name) {
+            return value;
+        }
+    }
+    return "";
+}
+
+void PgnGame::clear() {
+    line = 0;
+    tags.clear();
+    moves.clear();
+    result.clear();
+    error.clear();
+    error_line = 0;
+}
+
+bool PgnReader::next(PgnGame &game) {
+    game.clear();
+    bool movetext = false;
+    // line of the last tag read, 0 before the first
+    size_t tag_line = 0;
+
+    while (position_ < size_) {
+        char c = data_[position_];
+        if (c == '\n') {
+            line_++;
+            position_++;
+            continue;
+        }
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            position_++;
+            continue;
+        }
+        if (!game.line) {
+            game.line = line_;
+        }
+
+        size_t line = line_;
+        switch (c) {
+        case '[':
+            if (movetext) {
+                // the next game's tags, leave them for the next call
+                set_error(game, "game has no result", game.line);
+                return true;
+            }
+            if (tag_line && line > tag_line + 1) {
+                // a tag section after a blank line starts another game, so
+                // this one was cut off before its moves
+                set_error(game, "game has no moves or result", game.line);
+                return true;
+            }
+            read_tag(game);
+            tag_line = line;
+            continue;
+        case '{':
+            if (!skip_comment()) {
+                set_error(game, "unterminated comment", line);
+            }
+            continue;
+        case '(':
+            if (!skip_variation()) {
+                set_error(game, "unterminated variation", line);
+            }
+            continue;
+        case ';':
+            skip_line();
+            continue;
+        case '%':
+            // escape lines only start at the beginning of a line
+            if (position_ == 0 || data_[position_ - 1] == '\n') {
+                skip_line();
+                continue;
+            }
+            break;
+        case ')':
+        case ']':
+        case '}':
+            set_error(game, std::string("unexpected '") + c + "'", line);
+            position_++;
+            continue;
+        }
+
+        size_t start = position_;
+        while (position_ < size_ &&
+               !std::isspace(static_cast<unsigned char>(data_[position_])) &&
+               !std::strchr("{}()[];", data_[position_])) {
+            position_++;
+        }
+        std::string token(data_ + start, position_ - start);
+        movetext = true;
+
+        if (is_result(token)) {
+            game.result = token;
+            return true;
+        }
+        if (token[0] == '$') {
+            // numeric annotation glyph
+            continue;
+        }
+        // move numbers such as 12. or 12... may be attached to the move
+        size_t number_end = token.find_first_not_of("0123456789.");
+        if (number_end == std::string::npos) {
+            continue;
+        }
+        if (number_end > 0 && token[number_end - 1] == '.') {
+            token.erase(0, number_end);
+        }
+        game.moves.push_back({token, line});
+    }
+
+    if (!game.line) {
+        return false;
+    }
+    set_error(game, "game has no result", game.line);
+    return true;
+}
+
+void PgnReader::read_tag(PgnGame &game) {
+    size_t line = line_;
+    size_t end = position_;
+    while (end < size_ && data_[end] != '\n') {
+        end++;
+    }
+    // [Name "value"] on one line, with \" and \\ escaped in the value
+    std::string text(data_ + position_, end - position_);
+    position_ = end;
+
+    size_t name_start = 1;
+    size_t name_end = text.find_first_of(" \t\"", name_start);
+    size_t quote = text.find('"', name_start);
+    if (name_end == std::string::npos || quote == std::string::npos ||
+        name_end == name_start) {
+        set_error(game, "malformed tag", line);
+        return;
+    }
+    std::string value;
+    size_t i = quote + 1;
+    for (; i < text.size() && text[i] != '"'; i++) {
+        if (text[i] == '\\' && i + 1 < text.size()) {
+            i++;
+        }
+        value += text[i];
+    }
+    size_t close = text.find_first_not_of(" \t\r", i + 1);
+    if (i >= text.size() || close == std::string::npos || text[close] != ']') {
+        set_error(game, "malformed tag", line);
+        return;
+    }
+    game.tags.emplace_back(text.substr(name_start, name_end - name_start),
+                           value);
+}
+
+bool PgnReader::skip_comment() {
+    for (position_++; position_ < size_; position_++) {
+        if (data_[position_] == '\n') {
+            line_++;
+        } else if (data_[position_] == '}') {
+            position_++;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PgnReader::skip_variation() {
+    int depth = 0;
+    while (position_ < size_) {
+        char c = data_[position_];
+        if (c == '{') {
+            if (!skip_comment()) {
+                return false;
+            }
+            continue;
+        }
+        if (c == ';') {
+            skip_line();
+            continue;
+        }
+        if (c == '\n') {
+            line_++;
+        } else if (c == '(') {
+            depth++;
+        } else if (c == ')' && --depth == 0) {
+            position_++;
+            return true;
+        }
+        position_++;
+    }
+    return false;
+}
+
+void PgnReader::skip_line() {
+    while (position_ < size_ && data_[position_] != '\n') {
+        position_++;
+    }
+}
+
+Move parse_san(const ChessBoard &board, const MoveList &legal_moves,
+               const std::string &san, std::string &error) {
+    // check marks and annotations do not help to find the move
+    std::string text = san;
+    while (!text.empty() && std::strchr("+#!?", text.back())) {
+        text.pop_back();
+    }
+
+    if (text == "O-O" || text == "0-0" || text == "O-O-O" ||
+        text == "0-0-0") {
+        int direction = text.size() == 3 ? 2 : -2;
+        for (Move move : legal_moves) {
+            if (board.piece_type_on(move.from()) == King &&
+                move.to() - move.from() == direction) {
+                return move;
+            }
+        }
+        error = "illegal move " + san;
+        return Move();
+    }
+
+    PieceType piece = Pawn;
+    size_t start = 0;
+    const char *pieces = "PNBRQK";
+    if (!text.empty() && std::strchr(pieces, text[0])) {
+        piece = static_cast<PieceType>(std::strchr(pieces, text[0]) - pieces);
+        start = 1;
+    }
+
+    char promotion = '\0';
+    size_t equals = text.find('=');
+    if (equals != std::string::npos && equals + 2 == text.size()) {
+        promotion = std::tolower(text.back());
+        text.resize(equals);
+    } else if (piece == Pawn && text.size() > 2 &&
+               std::strchr("NBRQ", text.back())) {
+        promotion = std::tolower(text.back());
+        text.pop_back();
+    }
+
+    // what is left is an optional origin file and rank, an optional capture
+    // mark and the destination square
+    std::string origin;
+    for (size_t i = start; i + 2 < text.size(); i++) {
+        if (text[i] != 'x' && text[i] != ':') {
+            origin += text[i];
+        }
+    }
+    int file = -1;
+    int rank = -1;
+    bool valid = text.size() >= start + 2 && origin.size() <= 2 &&
+                 (equals == std::string::npos || promotion != '\0') &&
+                 (promotion == '\0' || std::strchr("nbrq", promotion));
+    for (char c : origin) {
+        if (c >= 'a' && c <= 'h' && file < 0) {
+            file = c - 'a';
+        } else if (c >= '1' && c <= '8' && rank < 0) {
+            rank = c - '1';
+        } else {
+            valid = false;
+        }
+    }
+    int to = -1;
+    if (valid) {
+        char to_file = text[text.size() - 2];
+        char to_rank = text[text.size() - 1];
+        if (to_file >= 'a' && to_file <= 'h' && to_rank >= '1' &&
+            to_rank <= '8') {
+            to = (to_rank - '1') * 8 + (to_file - 'a');
+        }
+    }
+    if (to < 0) {
+        error = "malformed move " + san;
+        return Move();
+    }
+
+    Move found;
+    int matches = 0;
+    for (Move move : legal_moves) {
+        if (move.to() == to && move.promotion() == promotion &&
+            board.piece_type_on(move.from()) == piece &&
+            (file < 0 || move.from() % 8 == file) &&
+            (rank < 0 || move.from() / 8 == rank)) {
+            found = move;
+            matches++;
+        }
+    }
+    if (matches == 1) {
+        return found;
+    }
+    error = (matches ? "ambiguous move " : "illegal move ") + san;
+    return Move();
+}
+
+bool replay_game(const PgnGame &game, ChessBoard &board, PgnError &error) {
+    if (!game.error.empty()) {
+        error = {game.error_line, game.error};
+        return false;
+    }
+
+    std::string fen = game.tag("FEN");
+    if (fen.empty()) {
+        board.set_fen(starting_fen);
+    } else if (!load_fen(board, fen, error.message)) {
+        error.line = game.line;
+        error.message = "invalid FEN tag: " + error.message;
+        return false;
+    }
+
+    MoveList legal_moves;
+    for (const auto &move : game.moves) {
+        board.generate_legal_moves(legal_moves);
+        Move parsed = parse_san(board, legal_moves, move.san, error.message);
+        if (parsed == Move()) {
+            error.line = move.line;
+            return false;
+        }
+        board.make_move(parsed);
+    }
+    return true;
+}
+
+ReplayStats replay_pgn(const char *data, size_t size, int threads,
+                       const PgnErrorHandler &on_error) {
+    threads = std::max(1, threads);
+    PgnReader reader(data, size);
+    std::mutex reader_mutex;
+    std::mutex error_mutex;
+    std::vector<ReplayStats> results(threads);
+    auto start = std::chrono::steady_clock::now();
+
+    // workers take small batches of games so the reader is not contended
+    auto work = [&](ReplayStats &stats) {
+        ChessBoard board;
+        std::vector<PgnGame> games(replay_batch_size);
+        PgnError error;
+        while (true) {
+            size_t count = 0;
+            {
+                std::lock_guard<std::mutex> lock(reader_mutex);
+                while (count < games.size() && reader.next(games[count])) {
+                    count++;
+                }
+            }
+            if (count == 0) {
+                return;
+            }
+
+            for (size_t i = 0; i < count; i++) {
+                if (replay_game(games[i], board, error)) {
+                    stats.games++;
+                    stats.moves += games[i].moves.size();
+                } else {
+                    stats.malformed++;
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    on_error(error);
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(work, std::ref(results[i]));
+    }
+    ReplayStats total;
+    for (int i = 0; i < threads; i++) {
+        workers[i].join();
+        total.games += results[i].games;
+        total.malformed += results[i].malformed;
+        total.moves += results[i].moves;
+    }
+    total.seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    return total;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "chessboard.h"
+#include "move.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// read-only memory map of a whole file
+class MappedFile {
+  public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    // false if the file cannot be opened or mapped
+    bool open(const std::string &path);
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+
+  private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+struct PgnMove {
+    std::string san;
+    size_t line;
+};
+
+struct PgnGame {
+    // line of the game's first tag or move
+    size_t line = 0;
+    std::vector<std::pair<std::string, std::string>> tags;
+    std::vector<PgnMove> moves;
+    // "1-0", "0-1", "1/2-1/2" or "*", empty if the game is cut off
+    std::string result;
+    // first syntax problem found in the game, empty if none
+    std::string error;
+    size_t error_line = 0;
+
+    // value of a tag, empty if missing
+    std::string tag(const std::string &name) const;
+    void clear();
+};
+
+// splits PGN text into games one at a time without copying the input.
+// comments, variations, NAGs and move numbers are skipped, so a game holds
+// only the SAN moves of its main line.
+class PgnReader {
+  public:
+    PgnReader(const char *data, size_t size) : data_(data), size_(size) {}
+
+    // read the next game, false at the end of the input
+    bool next(PgnGame &game);
+
+  private:
+    void read_tag(PgnGame &game);
+    // these skip past the closing character, false if the input ends first
+    bool skip_comment();
+    bool skip_variation();
+    void skip_line();
+
+    const char *data_;
+    size_t size_;
+    size_t position_ = 0;
+    size_t line_ = 1;
+};
+
+struct PgnError {
+    size_t line;
+    std::string message;
+};
+
+// the legal move written in SAN, e.g. Nbd7, exd6, e8=Q+ or O-O. the null
+// move with the reason in error if none or several moves match.
+Move parse_san(const ChessBoard &board, const MoveList &legal_moves,
+               const std::string &san, std::string &error);
+
+// play a game from its FEN tag or the starting position on board, false
+// with the error at the first problem
+bool replay_game(const PgnGame &game, ChessBoard &board, PgnError &error);
+
+struct ReplayStats {
+    uint64_t games = 0;
+    // games that were reported through the error handler
+    uint64_t malformed = 0;
+    uint64_t moves = 0;
+    double seconds = 0;
+};
+
+using PgnErrorHandler = std::function<void(const PgnError &error)>;
+
+// replay every game of PGN text on threads workers. errors are passed to
+// on_error one at a time, in no particular order, and the run carries on.
+ReplayStats replay_pgn(const char *data, size_t size, int threads,
+                       const PgnErrorHandler &on_error);
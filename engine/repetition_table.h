@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// multiset of position hashes, open addressed with linear probing. removal
+// shifts later entries of the probe sequence back instead of leaving
+// tombstones, so the table only ever holds the positions currently played.
+class RepetitionTable {
+  public:
+    // times key was added and not removed since
+    int count(uint64_t key) const {
+        if (entries_.empty()) {
+            return 0;
+        }
+        for (size_t i = key & mask(); entries_[i].count; i = (i + 1) & mask()) {
+            if (entries_[i].key == key) {
+                return entries_[i].count;
+            }
+        }
+        return 0;
+    }
+
+    void add(uint64_t key) {
+        if ((used_ + 1) * 2 > entries_.size()) {
+            grow();
+        }
+        size_t i = key & mask();
+        while (entries_[i].count && entries_[i].key != key) {
+            i = (i + 1) & mask();
+        }
+        if (entries_[i].count++ == 0) {
+            entries_[i].key = key;
+            used_++;
+        }
+    }
+
+    // key must have been added
+    void remove(uint64_t key) {
+        size_t i = key & mask();
+        while (entries_[i].key != key || !entries_[i].count) {
+            i = (i + 1) & mask();
+        }
+        if (--entries_[i].count > 0) {
+            return;
+        }
+
+        // move back any later entry whose home slot is not between the hole
+        // and its current slot, then clear the last hole
+        for (size_t j = (i + 1) & mask(); entries_[j].count;
+             j = (j + 1) & mask()) {
+            size_t home = entries_[j].key & mask();
+            if (((j - home) & mask()) >= ((j - i) & mask())) {
+                entries_[i] = entries_[j];
+                i = j;
+            }
+        }
+        entries_[i] = Entry();
+        used_--;
+    }
+
+    void clear() {
+        entries_.clear();
+        used_ = 0;
+    }
+
+  private:
+    struct Entry {
+        uint64_t key = 0;
+        // 0 marks an empty slot
+        int count = 0;
+    };
+
+    static const size_t initial_size = 64;
+
+    size_t mask() const { return entries_.size() - 1; }
+
+    void grow() {
+        std::vector<Entry> old;
+        old.swap(entries_);
+        entries_.resize(old.empty() ? initial_size : old.size() * 2);
+        for (const auto &entry : old) {
+            if (entry.count) {
+                size_t i = entry.key & mask();
+                while (entries_[i].count) {
+                    i = (i + 1) & mask();
+                }
+                entries_[i] = entry;
+            }
+        }
+    }
+
+    std::vector<Entry> entries_;
+    size_t used_ = 0;
+};
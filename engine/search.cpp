@@ -0,0 +1,395 @@
+#include "search.h"
+#include "engine.h"
+#include "evaluate.h"
+#include "nnue.h"
+#include "thread_budget.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// pawn, knight, bishop, rook, queen, king
+const int piece_values[6] = {100, 320, 330, 500, 900, 0};
+
+bool is_capture(const ChessBoard &board, const Move &move) {
+    return board.their_pieces().get(move.to()) ||
+           (board.pawns_.get(move.from()) && board.en_passant_.get(move.to()));
+}
+
+// mate scores are stored relative to the node so they stay valid when the
+// position is reached at a different ply
+int score_to_table(int score, int ply) {
+    if (score >= mate_score - max_search_depth) {
+        return score + ply;
+    }
+    if (score <= -mate_score + max_search_depth) {
+        return score - ply;
+    }
+    return score;
+}
+
+int score_from_table(int score, int ply) {
+    if (score >= mate_score - max_search_depth) {
+        return score - ply;
+    }
+    if (score <= -mate_score + max_search_depth) {
+        return score + ply;
+    }
+    return score;
+}
+
+// helper threads skip some iterations so they search at different depths
+// than the main thread and each other, indexed by (thread - 1) % 20
+const int skip_size[20] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                           3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+const int skip_phase[20] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3,
+                            4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+bool is_draw(const ChessBoard &board) {
+    return board.fifty_move_rule_ >= 100 ||
+           board.get_repetition_count() >= 1 || !board.has_mating_material();
+}
+
+class Searcher {
+  public:
+    // thread 0 is the main thread, the others are lazy smp helpers that
+    // only fill the table and stop when stop is set
+    Searcher(const ChessBoard &board, const SearchLimits &limits,
+             TranspositionTable *table, int thread, std::atomic<bool> &stop)
+        : board_(board), limits_(limits), table_(table), thread_(thread),
+          stop_(stop), start_(std::chrono::steady_clock::now()) {}
+
+    SearchResult run();
+
+  private:
+    int search(int depth, int alpha, int beta, int ply);
+    int quiescence(int alpha, int beta);
+    void order_moves(MoveList &moves, int ply, const Move &pv_move) const;
+    void check_time();
+    int elapsed_ms() const;
+
+    ChessBoard board_;
+    SearchLimits limits_;
+    TranspositionTable *table_;
+    int thread_;
+    std::atomic<bool> &stop_;
+    std::chrono::steady_clock::time_point start_;
+    uint64_t nodes_ = 0;
+    uint64_t table_probes_ = 0;
+    uint64_t table_hits_ = 0;
+    bool stopped_ = false;
+    Move killers_[max_search_depth + 1][2];
+    PawnTable pawn_table_;
+};
+
+int Searcher::elapsed_ms() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - start_)
+        .count();
+}
+
+void Searcher::check_time() {
+    if ((nodes_ & 1023) != 0) {
+        return;
+    }
+    if (stop_.load(std::memory_order_relaxed) ||
+        (limits_.time_ms > 0 && elapsed_ms() >= limits_.time_ms)) {
+        stopped_ = true;
+    }
+}
+
+void Searcher::order_moves(MoveList &moves, int ply,
+                           const Move &pv_move) const {
+    int scores[max_moves];
+
+    for (int i = 0; i < moves.size(); i++) {
+        const Move &move = moves[i];
+        int score = 0;
+        if (move == pv_move) {
+            score = 100000;
+        } else if (is_capture(board_, move)) {
+            // most valuable victim, least valuable attacker
+            PieceType victim = board_.piece_type_on(move.to());
+            PieceType attacker = board_.piece_type_on(move.from());
+            score = 50000 +
+                    10 * piece_values[victim == NoPiece ? Pawn : victim] -
+                    piece_values[attacker] / 10;
+        } else if (move.promotion() == 'q') {
+            score = 40000;
+        } else if (move == killers_[ply][0]) {
+            score = 30000;
+        } else if (move == killers_[ply][1]) {
+            score = 29000;
+        }
+        scores[i] = score;
+    }
+
+    // stable insertion sort, move lists are short
+    for (int i = 1; i < moves.size(); i++) {
+        Move move = moves[i];
+        int score = scores[i];
+        int j = i - 1;
+        for (; j >= 0 && scores[j] < score; j--) {
+            moves[j + 1] = moves[j];
+            scores[j + 1] = scores[j];
+        }
+        moves[j + 1] = move;
+        scores[j + 1] = score;
+    }
+}
+
+int Searcher::quiescence(int alpha, int beta) {
+    nodes_++;
+    check_time();
+    if (stopped_) {
+        return 0;
+    }
+
+    int stand_pat = evaluate(board_, &pawn_table_);
+    if (stand_pat >= beta) {
+        return stand_pat;
+    }
+    alpha = std::max(alpha, stand_pat);
+
+    MoveList legal_moves;
+    board_.generate_legal_moves(legal_moves);
+    MoveList moves;
+    for (const auto &move : legal_moves) {
+        if (is_capture(board_, move) || move.promotion() == 'q') {
+            moves.push_back(move);
+        }
+    }
+    order_moves(moves, 0, Move());
+
+    for (const auto &move : moves) {
+        board_.make_move(move);
+        int score = -quiescence(-beta, -alpha);
+        board_.unmake_move();
+        if (stopped_) {
+            return 0;
+        }
+        if (score >= beta) {
+            return score;
+        }
+        alpha = std::max(alpha, score);
+    }
+
+    return alpha;
+}
+
+int Searcher::search(int depth, int alpha, int beta, int ply) {
+    if (depth <= 0) {
+        return quiescence(alpha, beta);
+    }
+
+    nodes_++;
+    check_time();
+    if (stopped_) {
+        return 0;
+    }
+
+    if (is_draw(board_)) {
+        return 0;
+    }
+
+    Move table_move;
+    if (table_) {
+        TTEntry entry;
+        table_probes_++;
+        if (table_->probe(board_.hash_, entry)) {
+            table_hits_++;
+            table_move = entry.move;
+            int score = score_from_table(entry.score, ply);
+            if (entry.depth >= depth &&
+                (entry.bound == Bound::Exact ||
+                 (entry.bound == Bound::Lower && score >= beta) ||
+                 (entry.bound == Bound::Upper && score <= alpha))) {
+                return score;
+            }
+        }
+    }
+
+    MoveList moves;
+    board_.generate_legal_moves(moves);
+    if (moves.empty()) {
+        // checkmate or stalemate
+        return board_.is_player_in_check(board_.player_) ? -mate_score + ply
+                                                        : 0;
+    }
+    order_moves(moves, ply, table_move);
+
+    int original_alpha = alpha;
+    Move best_move;
+    bool first = true;
+    for (const auto &move : moves) {
+        board_.make_move(move);
+
+        int score;
+        if (first) {
+            score = -search(depth - 1, -beta, -alpha, ply + 1);
+            first = false;
+        } else {
+            // null window search, re-search if it fails high
+            score = -search(depth - 1, -alpha - 1, -alpha, ply + 1);
+            if (score > alpha && score < beta) {
+                score = -search(depth - 1, -beta, -alpha, ply + 1);
+            }
+        }
+        board_.unmake_move();
+        if (stopped_) {
+            return 0;
+        }
+
+        if (score >= beta) {
+            if (!is_capture(board_, move)) {
+                killers_[ply][1] = killers_[ply][0];
+                killers_[ply][0] = move;
+            }
+            if (table_) {
+                table_->store(board_.hash_, move, score_to_table(score, ply),
+                              depth, Bound::Lower);
+            }
+            return score;
+        }
+        if (score > alpha) {
+            alpha = score;
+            best_move = move;
+        }
+    }
+
+    if (table_) {
+        table_->store(board_.hash_, best_move, score_to_table(alpha, ply),
+                      depth,
+                      alpha > original_alpha ? Bound::Exact : Bound::Upper);
+    }
+    return alpha;
+}
+
+SearchResult Searcher::run() {
+    SearchResult result;
+
+    MoveList moves;
+    board_.generate_legal_moves(moves);
+    if (moves.empty()) {
+        return result;
+    }
+    result.best_move = moves[0];
+    refresh_accumulators(board_);
+
+    for (int depth = 1; depth <= std::min(limits_.depth, max_search_depth);
+         depth++) {
+        if (thread_ > 0) {
+            int i = (thread_ - 1) % 20;
+            if (((depth + skip_phase[i]) / skip_size[i]) % 2 != 0) {
+                continue;
+            }
+        }
+        order_moves(moves, 0, result.best_move);
+
+        int alpha = -infinite_score;
+        int beta = infinite_score;
+        Move best_move = moves[0];
+        bool first = true;
+
+        for (const auto &move : moves) {
+            board_.make_move(move);
+
+            int score;
+            if (first) {
+                score = -search(depth - 1, -beta, -alpha, 1);
+                first = false;
+            } else {
+                score = -search(depth - 1, -alpha - 1, -alpha, 1);
+                if (score > alpha && !stopped_) {
+                    score = -search(depth - 1, -beta, -alpha, 1);
+                }
+            }
+            board_.unmake_move();
+            if (stopped_) {
+                break;
+            }
+
+            if (score > alpha) {
+                alpha = score;
+                best_move = move;
+            }
+        }
+
+        // discard incomplete iterations
+        if (stopped_) {
+            break;
+        }
+
+        result.best_move = best_move;
+        result.score = alpha;
+        result.depth = depth;
+        if (table_) {
+            table_->store(board_.hash_, best_move, score_to_table(alpha, 0),
+                          depth, Bound::Exact);
+        }
+
+        // stop early on forced mate or if the next iteration won't finish
+        if (std::abs(alpha) >= mate_score - max_search_depth) {
+            break;
+        }
+        if (limits_.time_ms > 0 && elapsed_ms() * 2 >= limits_.time_ms) {
+            break;
+        }
+    }
+
+    result.nodes = nodes_;
+    result.pawn_probes = pawn_table_.probes_;
+    result.pawn_hits = pawn_table_.hits_;
+    if (table_) {
+        table_->add_stats(table_probes_, table_hits_);
+    }
+    return result;
+}
+
+} // namespace
+
+SearchResult search(const ChessBoard &board, const SearchLimits &limits,
+                    TranspositionTable *table) {
+    if (table) {
+        table->new_search();
+    }
+    std::atomic<bool> stop(false);
+
+    // helpers only help through the shared table, and more threads than
+    // cores only slow the search down, so they come from the budget shared
+    // with every other search
+    ThreadGrant grant(table ? limits.threads : 1);
+    int threads = grant.threads();
+    std::vector<SearchResult> helper_results(threads);
+    std::vector<std::thread> helpers;
+    for (int i = 1; i < threads; i++) {
+        try {
+            helpers.emplace_back([&, i]() {
+                Searcher helper(board, limits, table, i, stop);
+                helper_results[i] = helper.run();
+            });
+        } catch (const std::system_error &) {
+            // out of threads, search with the helpers already running
+            break;
+        }
+    }
+
+    Searcher searcher(board, limits, table, 0, stop);
+    SearchResult result = searcher.run();
+
+    stop = true;
+    for (auto &helper : helpers) {
+        helper.join();
+    }
+    for (const auto &helper : helper_results) {
+        result.nodes += helper.nodes;
+        result.pawn_probes += helper.pawn_probes;
+        result.pawn_hits += helper.pawn_hits;
+    }
+    return result;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "chessboard.h"
+#include "move.h"
+#include "transposition_table.h"
+
+#include <cstdint>
+
+const int max_search_depth = 64;
+const int mate_score = 32000;
+const int infinite_score = 32001;
+
+struct SearchLimits {
+    // maximum iterative deepening depth
+    int depth = max_search_depth;
+    // time budget in milliseconds, 0 means no time limit
+    int time_ms = 0;
+    // lazy smp search threads sharing the transposition table, fewer when
+    // other searches hold the cores
+    int threads = 1;
+};
+
+struct SearchResult {
+    Move best_move;
+    int score = 0;
+    int depth = 0;
+    uint64_t nodes = 0;
+    // pawn structure cache use, summed over threads
+    uint64_t pawn_probes = 0;
+    uint64_t pawn_hits = 0;
+};
+
+// iterative deepening principal variation search from the given position,
+// sharing results through the table if one is given. extra threads need a
+// table and search the same root on their own board copies.
+SearchResult search(const ChessBoard &board, const SearchLimits &limits,
+                    TranspositionTable *table = nullptr);
@@ -0,0 +1,89 @@
+#include "session.h"
+
+#include <functional>
+#include <mutex>
+#include <random>
+
+namespace {
+
+int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// unguessable ids so players can't act on each other's games
+std::string generate_id() {
+    thread_local std::mt19937_64 generator(std::random_device{}());
+    const char digits[] = "0123456789abcdef";
+    uint64_t value = generator();
+    std::string id(16, '0');
+    for (int i = 15; i >= 0; i--) {
+        id[i] = digits[value & 0xF];
+        value >>= 4;
+    }
+    return id;
+}
+
+} // namespace
+
+SessionTable::Entry::Entry(std::shared_ptr<GameSession> session)
+    : session(std::move(session)), last_access(now_ms()) {}
+
+SessionTable::Shard &SessionTable::shard_of(const std::string &id) {
+    return shards_[std::hash<std::string>()(id) % shard_count];
+}
+
+std::string SessionTable::create() {
+    auto session = std::make_shared<GameSession>();
+
+    while (true) {
+        std::string id = generate_id();
+        Shard &shard = shard_of(id);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        expire(shard);
+        if (shard.sessions.try_emplace(id, session).second) {
+            return id;
+        }
+    }
+}
+
+std::shared_ptr<GameSession> SessionTable::find(const std::string &id) {
+    Shard &shard = shard_of(id);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.sessions.find(id);
+    if (it == shard.sessions.end()) {
+        return nullptr;
+    }
+    it->second.last_access.store(now_ms(), std::memory_order_relaxed);
+    return it->second.session;
+}
+
+void SessionTable::remove(const std::string &id) {
+    Shard &shard = shard_of(id);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    shard.sessions.erase(id);
+}
+
+size_t SessionTable::size() const {
+    size_t total = 0;
+    for (const auto &shard : shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        total += shard.sessions.size();
+    }
+    return total;
+}
+
+void SessionTable::expire(Shard &shard) {
+    int64_t cutoff =
+        now_ms() -
+        std::chrono::duration_cast<std::chrono::milliseconds>(session_timeout)
+            .count();
+    for (auto it = shard.sessions.begin(); it != shard.sessions.end();) {
+        if (it->second.last_access.load(std::memory_order_relaxed) < cutoff) {
+            it = shard.sessions.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "engine.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+// games that are not touched for this long are dropped on the next create()
+const std::chrono::minutes session_timeout(60);
+
+// concurrent map from game id to game, split into independently locked
+// shards so lookups for different games rarely contend
+class SessionTable {
+  public:
+    // start a new game and return its id
+    std::string create();
+    // the game with this id, or nullptr if there is none
+    std::shared_ptr<GameSession> find(const std::string &id);
+    void remove(const std::string &id);
+    size_t size() const;
+
+  private:
+    struct Entry {
+        explicit Entry(std::shared_ptr<GameSession> session);
+
+        std::shared_ptr<GameSession> session;
+        std::atomic<int64_t> last_access;
+    };
+
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, Entry> sessions;
+    };
+
+    static const int shard_count = 64;
+
+    Shard &shard_of(const std::string &id);
+    // drop idle games of a shard, the shard must be locked exclusively
+    void expire(Shard &shard);
+
+    std::array<Shard, shard_count> shards_;
+};
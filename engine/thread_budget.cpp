@@ -0,0 +1,27 @@
+#include "thread_budget.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace {
+
+// threads held by all grants, may exceed the core count by the grants that
+// got their single fallback thread
+std::atomic<int> threads_in_use(0);
+
+} // namespace
+
+ThreadGrant::ThreadGrant(int wanted) {
+    static const int cores = std::max(1u, std::thread::hardware_concurrency());
+    wanted = std::max(1, wanted);
+    int used = threads_in_use.load(std::memory_order_relaxed);
+    do {
+        threads_ = std::clamp(cores - used, 1, wanted);
+    } while (!threads_in_use.compare_exchange_weak(
+        used, used + threads_, std::memory_order_relaxed));
+}
+
+ThreadGrant::~ThreadGrant() {
+    threads_in_use.fetch_sub(threads_, std::memory_order_relaxed);
+}
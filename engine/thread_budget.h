@@ -0,0 +1,20 @@
+#pragma once
+
+// threads taken from a process-wide budget of one per core, given back when
+// the grant is destroyed. searches and batch analyses hold one while they
+// run, so concurrent requests share the cores instead of each starting a
+// full set of threads.
+class ThreadGrant {
+  public:
+    // at most wanted threads, and one even when the budget is spent so the
+    // caller can always make progress
+    explicit ThreadGrant(int wanted);
+    ThreadGrant(const ThreadGrant &) = delete;
+    ThreadGrant &operator=(const ThreadGrant &) = delete;
+    ~ThreadGrant();
+
+    int threads() const { return threads_; }
+
+  private:
+    int threads_;
+};
@@ -0,0 +1,179 @@
+#include "transposition_table.h"
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+
+namespace {
+
+// data layout: move in bits 0-15, score 16-31, depth 32-39, bound 40-41,
+// generation 42-63
+const uint32_t generation_mask = 0x3FFFFF;
+
+// shortest time between generations
+const int64_t generation_interval_ms = 1000;
+
+int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+uint64_t encode_move(const Move &move) { return move.raw(); }
+
+Move decode_move(uint64_t data) { return Move::from_raw(data & 0xFFFF); }
+
+uint64_t pack(const Move &move, int score, int depth, Bound bound,
+              uint32_t generation) {
+    return encode_move(move) |
+           (static_cast<uint64_t>(static_cast<uint16_t>(score)) << 16) |
+           (static_cast<uint64_t>(depth & 0xFF) << 32) |
+           (static_cast<uint64_t>(bound) << 40) |
+           (static_cast<uint64_t>(generation) << 42);
+}
+
+int data_depth(uint64_t data) { return (data >> 32) & 0xFF; }
+
+Bound data_bound(uint64_t data) {
+    return static_cast<Bound>((data >> 40) & 0x3);
+}
+
+uint32_t data_generation(uint64_t data) {
+    return (data >> 42) & generation_mask;
+}
+
+} // namespace
+
+TranspositionTable::TranspositionTable(size_t size_mb) {
+    // round down to a power of two so the index is a mask
+    size_t count = 1;
+    while (count * 2 * sizeof(Bucket) <= size_mb * 1024 * 1024) {
+        count *= 2;
+    }
+    memory_.reset(std::calloc(count + 1, sizeof(Bucket)));
+    if (!memory_) {
+        throw std::bad_alloc();
+    }
+    // align the buckets to cache lines
+    uintptr_t address = reinterpret_cast<uintptr_t>(memory_.get());
+    buckets_ = reinterpret_cast<Bucket *>((address + alignof(Bucket) - 1) &
+                                          ~(alignof(Bucket) - 1));
+    mask_ = count - 1;
+}
+
+void TranspositionTable::clear() {
+    for (size_t i = 0; i <= mask_; i++) {
+        for (auto &entry : buckets_[i].entries) {
+            entry.key.store(0, std::memory_order_relaxed);
+            entry.data.store(0, std::memory_order_relaxed);
+        }
+    }
+    generation_ = 0;
+    generation_start_ms_ = 0;
+    probes_ = 0;
+    hits_ = 0;
+}
+
+void TranspositionTable::new_search() {
+    // the first search to find the generation expired starts the next one,
+    // searches starting at the same time join it. the counter is masked on
+    // reads and its range is a multiple of the generation range, so it
+    // wraps cleanly.
+    int64_t now = now_ms();
+    int64_t start = generation_start_ms_.load(std::memory_order_relaxed);
+    if (now - start >= generation_interval_ms &&
+        generation_start_ms_.compare_exchange_strong(
+            start, now, std::memory_order_relaxed)) {
+        generation_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool TranspositionTable::probe(uint64_t hash, TTEntry &entry) const {
+    const Bucket &bucket = buckets_[hash & mask_];
+    for (const auto &slot : bucket.entries) {
+        uint64_t key = slot.key.load(std::memory_order_relaxed);
+        uint64_t data = slot.data.load(std::memory_order_relaxed);
+        if ((key ^ data) != hash || data_bound(data) == Bound::None) {
+            continue;
+        }
+        entry.move = decode_move(data);
+        entry.score = static_cast<int16_t>((data >> 16) & 0xFFFF);
+        entry.depth = data_depth(data);
+        entry.bound = data_bound(data);
+        return true;
+    }
+    return false;
+}
+
+void TranspositionTable::store(uint64_t hash, const Move &move, int score,
+                               int depth, Bound bound) {
+    Bucket &bucket = buckets_[hash & mask_];
+    uint32_t generation =
+        generation_.load(std::memory_order_relaxed) & generation_mask;
+
+    // overwrite the same position, otherwise the shallowest and oldest entry
+    Entry *replace = &bucket.entries[0];
+    int replace_value = 1 << 30;
+    for (auto &slot : bucket.entries) {
+        uint64_t key = slot.key.load(std::memory_order_relaxed);
+        uint64_t data = slot.data.load(std::memory_order_relaxed);
+        if ((key ^ data) == hash) {
+            // keep deeper results of the current generation unless exact
+            if (bound != Bound::Exact &&
+                data_generation(data) == generation &&
+                data_depth(data) > depth + 2) {
+                return;
+            }
+            Move best_move = move;
+            if (best_move == Move()) {
+                best_move = decode_move(data);
+            }
+            uint64_t new_data = pack(best_move, score, depth, bound, generation);
+            slot.key.store(hash ^ new_data, std::memory_order_relaxed);
+            slot.data.store(new_data, std::memory_order_relaxed);
+            return;
+        }
+
+        int age = (generation - data_generation(data)) & generation_mask;
+        int value = data_depth(data) - 8 * age;
+        if (data_bound(data) == Bound::None) {
+            value = -(1 << 30);
+        }
+        if (value < replace_value) {
+            replace_value = value;
+            replace = &slot;
+        }
+    }
+
+    uint64_t new_data = pack(move, score, depth, bound, generation);
+    replace->key.store(hash ^ new_data, std::memory_order_relaxed);
+    replace->data.store(new_data, std::memory_order_relaxed);
+}
+
+void TranspositionTable::add_stats(uint64_t probes, uint64_t hits) {
+    probes_.fetch_add(probes, std::memory_order_relaxed);
+    hits_.fetch_add(hits, std::memory_order_relaxed);
+}
+
+TTStats TranspositionTable::stats() const {
+    TTStats stats;
+    stats.probes = probes_.load(std::memory_order_relaxed);
+    stats.hits = hits_.load(std::memory_order_relaxed);
+
+    // sample the first thousand buckets
+    size_t sample = std::min<size_t>(1000, mask_ + 1);
+    uint32_t generation =
+        generation_.load(std::memory_order_relaxed) & generation_mask;
+    int used = 0;
+    for (size_t i = 0; i < sample; i++) {
+        for (const auto &slot : buckets_[i].entries) {
+            uint64_t data = slot.data.load(std::memory_order_relaxed);
+            if (data_bound(data) != Bound::None &&
+                data_generation(data) == generation) {
+                used++;
+            }
+        }
+    }
+    stats.hashfull = used * 1000 / (sample * bucket_size);
+    return stats;
+}
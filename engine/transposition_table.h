@@ -0,0 +1,73 @@
+#pragma once
+
+#include "move.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+
+enum class Bound : uint8_t { None, Upper, Lower, Exact };
+
+struct TTEntry {
+    Move move;
+    int score = 0;
+    int depth = 0;
+    Bound bound = Bound::None;
+};
+
+struct TTStats {
+    uint64_t probes = 0;
+    uint64_t hits = 0;
+    // permille of sampled slots written during the current generation
+    int hashfull = 0;
+};
+
+// search result cache shared by all search threads, keyed by the zobrist
+// hash. entries are grouped in cache-line sized buckets and, like the perft
+// table, store key ^ data next to data so torn writes fail verification.
+//
+// entries are aged by time rather than by searches: new_search starts a new
+// generation only once the current one is a second old, so the games a
+// server searches at the same time share a generation instead of aging out
+// each other's entries. the generation has 22 bits and wraps after more
+// than a month of searching.
+class TranspositionTable {
+  public:
+    explicit TranspositionTable(size_t size_mb);
+
+    bool probe(uint64_t hash, TTEntry &entry) const;
+    void store(uint64_t hash, const Move &move, int score, int depth,
+               Bound bound);
+
+    // age existing entries so they are replaced first, unless the current
+    // generation started less than a second ago
+    void new_search();
+    void clear();
+
+    // search threads count their own probes and add them here when done
+    void add_stats(uint64_t probes, uint64_t hits);
+    TTStats stats() const;
+
+  private:
+    struct Entry {
+        std::atomic<uint64_t> key;
+        std::atomic<uint64_t> data;
+    };
+
+    static const int bucket_size = 4;
+
+    struct alignas(64) Bucket {
+        Entry entries[bucket_size];
+    };
+
+    // calloc'd so untouched pages cost nothing until the search uses them
+    std::unique_ptr<void, void (*)(void *)> memory_{nullptr, std::free};
+    Bucket *buckets_;
+    size_t mask_;
+    std::atomic<uint32_t> generation_{0};
+    // steady clock time the current generation started, in milliseconds
+    std::atomic<int64_t> generation_start_ms_{0};
+    std::atomic<uint64_t> probes_{0};
+    std::atomic<uint64_t> hits_{0};
+};
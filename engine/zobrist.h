@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+// splitmix64 step, used to fill the zobrist keys at compile time
+constexpr uint64_t splitmix64(uint64_t &state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+struct ZobristKeys {
+    uint64_t pieces[2][6][64];
+    uint64_t castle[4];
+    uint64_t en_passant[8];
+    uint64_t white_to_move;
+};
+
+constexpr ZobristKeys make_zobrist_keys() {
+    ZobristKeys keys{};
+    uint64_t state = 0x5EED;
+    for (int i = 0; i < 8; i++) {
+        keys.en_passant[i] = splitmix64(state);
+    }
+    for (int i = 0; i < 4; i++) {
+        keys.castle[i] = splitmix64(state);
+    }
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 6; j++) {
+            for (int k = 0; k < 64; k++) {
+                keys.pieces[i][j][k] = splitmix64(state);
+            }
+        }
+    }
+    keys.white_to_move = splitmix64(state);
+    return keys;
+}
+
+inline constexpr ZobristKeys zobrist_keys = make_zobrist_keys();
+
+inline constexpr const auto &PieceKeys = zobrist_keys.pieces;
+inline constexpr const auto &CastleKeys = zobrist_keys.castle;
+inline constexpr const auto &EnPassantKeys = zobrist_keys.en_passant;
+inline constexpr const uint64_t &whiteToMoveKey = zobrist_keys.white_to_move;
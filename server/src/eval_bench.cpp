@@ -0,0 +1,122 @@
+#include "engine.h"
+#include "evaluate.h"
+#include "nnue.h"
+#include "perft.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+const int default_bench_seconds = 3;
+const int bench_depth = 3;
+
+using Evaluator = int (*)(const ChessBoard &, PawnTable *);
+
+int nnue(const ChessBoard &board, PawnTable *) { return evaluate_nnue(board); }
+
+struct BenchResult {
+    uint64_t evaluations = 0;
+    int64_t checksum = 0;
+    double seconds = 0;
+};
+
+// evaluate every node of the tree below board like a search does, so
+// incremental updates are measured along with the evaluation itself
+void walk(ChessBoard &board, int depth, Evaluator eval, PawnTable *pawn_table,
+          BenchResult &result) {
+    if (eval) {
+        result.checksum += eval(board, pawn_table);
+    }
+    result.evaluations++;
+    if (depth == 0) {
+        return;
+    }
+    MoveList moves;
+    board.generate_legal_moves(moves);
+    for (const auto &move : moves) {
+        board.make_move(move);
+        walk(board, depth - 1, eval, pawn_table, result);
+        board.unmake_move();
+    }
+}
+
+// walk the suite positions repeatedly for the given time, eval can be null to
+// measure the walk alone
+BenchResult run_bench(int seconds, Evaluator eval,
+                      PawnTable *pawn_table = nullptr) {
+    BenchResult result;
+    auto start = std::chrono::steady_clock::now();
+    while (result.seconds < seconds) {
+        for (const auto &position : perft_suite) {
+            ChessBoard board(position.fen);
+            walk(board, bench_depth, eval, pawn_table, result);
+        }
+        result.seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    }
+    return result;
+}
+
+void print_result(const std::string &name, const BenchResult &result) {
+    std::cout << name << ": " << result.evaluations << " nodes in "
+              << result.seconds << " s ("
+              << static_cast<uint64_t>(result.evaluations / result.seconds)
+              << " nodes/s)" << std::endl;
+}
+
+// usage: eval_bench [seconds] [--network file]
+// evaluates every node up to three plies from the perft suite positions with
+// each available evaluator
+int main(int argc, char *argv[]) {
+    int seconds = default_bench_seconds;
+    std::string network_file = default_network_file;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--network" && i + 1 < argc) {
+            network_file = argv[++i];
+        } else {
+            seconds = std::max(1, std::atoi(arg.c_str()));
+        }
+    }
+    init_engine(1, network_file);
+
+    print_result("walk only", run_bench(seconds, nullptr));
+    print_result("classical", run_bench(seconds, evaluate_classical));
+    PawnTable pawn_table;
+    print_result("classical with pawn table",
+                 run_bench(seconds, evaluate_classical, &pawn_table));
+    std::cout << "pawn table hit rate "
+              << 100.0 * pawn_table.hits_ /
+                     std::max<uint64_t>(pawn_table.probes_, 1)
+              << "%" << std::endl;
+    if (!network_loaded()) {
+        std::cout << "no network at " << network_file << std::endl;
+        return 0;
+    }
+
+    // a single pass over the tree checks that the simd and scalar paths agree
+    BenchResult scalar_check;
+    BenchResult simd_check;
+    set_nnue_avx2(false);
+    for (const auto &position : perft_suite) {
+        ChessBoard board(position.fen);
+        walk(board, bench_depth, nnue, nullptr, scalar_check);
+    }
+    print_result("nnue scalar", run_bench(seconds, nnue));
+
+    if (set_nnue_avx2(true)) {
+        for (const auto &position : perft_suite) {
+            ChessBoard board(position.fen);
+            walk(board, bench_depth, nnue, nullptr, simd_check);
+        }
+        print_result("nnue avx2", run_bench(seconds, nnue));
+        if (simd_check.checksum != scalar_check.checksum) {
+            std::cout << "avx2 and scalar evaluations differ" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
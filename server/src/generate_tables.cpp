@@ -0,0 +1,129 @@
+#include "move_generator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// writes the packed sliding piece attack tables and between_squares as a
+// C++ source file so the engine starts without computing them
+// usage: generate_tables <output.cpp>
+
+std::vector<Bitboard> magic_data;
+std::vector<Bitboard> pext_data;
+int bishop_offset_data[64];
+int rook_offset_data[64];
+Bitboard between_data[64][64];
+
+// append one square's attacks for every blocker subset of mask. a subset's
+// pext index is its enumeration index, since get_blockers assigns index
+// bits to mask bits from the least significant one like pext does
+bool add_square(int square, Bitboard mask, uint64_t magic, int shift_bits,
+                bool rook, int &offset) {
+    if (mask.count() != shift_bits) {
+        fprintf(stderr, "square %d: mask has %d bits, magic uses %d\n",
+                square, mask.count(), shift_bits);
+        return false;
+    }
+
+    offset = magic_data.size();
+    magic_data.resize(offset + (1 << shift_bits));
+    pext_data.resize(offset + (1 << shift_bits));
+    for (int i = 0; i < (1 << shift_bits); i++) {
+        uint64_t blockers = get_blockers(i, mask);
+        uint64_t key = (blockers * magic) >> (64 - shift_bits);
+        Bitboard attacks =
+            rook ? generate_rook_moves_slow(Square(square), Bitboard(blockers))
+                 : generate_bishop_moves_slow(Square(square),
+                                              Bitboard(blockers));
+        magic_data[offset + key] = attacks;
+        pext_data[offset + i] = attacks;
+    }
+    return true;
+}
+
+void fill_between_squares() {
+    for (int from = 0; from < 64; from++) {
+        for (int to = 0; to < 64; to++) {
+            Square a(from), b(to);
+            Bitboard a_mask(1ULL << from), b_mask(1ULL << to);
+            if (from == to) {
+                continue;
+            }
+            if (a.rank_ == b.rank_ || a.file_ == b.file_) {
+                between_data[from][to] = generate_rook_moves_slow(a, b_mask) &
+                                         generate_rook_moves_slow(b, a_mask);
+            } else if (abs(a.rank_ - b.rank_) == abs(a.file_ - b.file_)) {
+                between_data[from][to] =
+                    generate_bishop_moves_slow(a, b_mask) &
+                    generate_bishop_moves_slow(b, a_mask);
+            }
+        }
+    }
+}
+
+void write_bitboards(FILE *file, const Bitboard *table, int size) {
+    for (int i = 0; i < size; i++) {
+        fprintf(file, "%s0x%llxULL%s", i % 4 == 0 ? "    " : "",
+                static_cast<unsigned long long>(table[i].bitboard_),
+                i % 4 == 3 || i + 1 == size ? ",\n" : ", ");
+    }
+}
+
+void write_offsets(FILE *file, const char *name, const int *offsets) {
+    fprintf(file, "const int %s[64] = {\n", name);
+    for (int i = 0; i < 64; i++) {
+        fprintf(file, "%s%d%s", i % 8 == 0 ? "    " : "", offsets[i],
+                i % 8 == 7 ? ",\n" : ", ");
+    }
+    fprintf(file, "};\n\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: generate_tables <output.cpp>\n");
+        return 1;
+    }
+
+    for (int square = 0; square < 64; square++) {
+        if (!add_square(square, bishop_masks[square],
+                        bishop_magic_numbers[square],
+                        bishop_shift_bits[square], false,
+                        bishop_offset_data[square])) {
+            return 1;
+        }
+    }
+    for (int square = 0; square < 64; square++) {
+        if (!add_square(square, rook_masks[square], rook_magic_numbers[square],
+                        rook_shift_bits[square], true,
+                        rook_offset_data[square])) {
+            return 1;
+        }
+    }
+    if (magic_data.size() != slider_attacks_size) {
+        fprintf(stderr, "expected %d attack entries, generated %zu\n",
+                slider_attacks_size, magic_data.size());
+        return 1;
+    }
+    fill_between_squares();
+
+    FILE *file = fopen(argv[1], "w");
+    if (!file) {
+        perror(argv[1]);
+        return 1;
+    }
+    fprintf(file, "// generated by generate_tables, do not edit\n"
+                  "#include \"move_generator.h\"\n\n");
+    write_offsets(file, "bishop_offsets", bishop_offset_data);
+    write_offsets(file, "rook_offsets", rook_offset_data);
+
+    fprintf(file, "const Bitboard magic_attacks[slider_attacks_size] = {\n");
+    write_bitboards(file, magic_data.data(), magic_data.size());
+    fprintf(file, "};\n\n");
+    fprintf(file, "const Bitboard pext_attacks[slider_attacks_size] = {\n");
+    write_bitboards(file, pext_data.data(), pext_data.size());
+    fprintf(file, "};\n\n");
+    fprintf(file, "const Bitboard between_squares[64][64] = {\n");
+    write_bitboards(file, &between_data[0][0], 64 * 64);
+    fprintf(file, "};\n");
+
+    return fclose(file) == 0 ? 0 : 1;
+}
@@ -0,0 +1,688 @@
+#include "http_server.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t max_header_size = 64 * 1024;
+const size_t max_body_size = 16 * 1024 * 1024;
+const int64_t idle_timeout_ms = 60 * 1000;
+const int max_events = 256;
+// streamed output is buffered into chunks of about this size, and a worker
+// waits while more than max_stream_queued bytes are not yet written
+const size_t stream_chunk_size = 16 * 1024;
+const size_t max_stream_queued = 256 * 1024;
+// a worker gives up on a stream whose client has read nothing for this long
+const std::chrono::milliseconds stream_stall_timeout(idle_timeout_ms);
+
+enum class ParseResult { Incomplete, Complete, Invalid, TooLarge };
+
+int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+bool set_non_blocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+std::string to_lower(std::string value) {
+    std::transform(value.begin(), value.end(), value.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return value;
+}
+
+std::string trim(const std::string &value) {
+    size_t start = value.find_first_not_of(" \t");
+    size_t end = value.find_last_not_of(" \t");
+    return start == std::string::npos ? ""
+                                      : value.substr(start, end - start + 1);
+}
+
+std::string url_decode(const std::string &value) {
+    std::string decoded;
+    for (size_t i = 0; i < value.size(); i++) {
+        if (value[i] == '+') {
+            decoded += ' ';
+        } else if (value[i] == '%' && i + 2 < value.size() &&
+                   std::isxdigit(value[i + 1]) && std::isxdigit(value[i + 2])) {
+            decoded += static_cast<char>(
+                std::stoi(value.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        } else {
+            decoded += value[i];
+        }
+    }
+    return decoded;
+}
+
+const char *status_text(int status) {
+    switch (status) {
+    case 200:
+        return "OK";
+    case 400:
+        return "Bad Request";
+    case 404:
+        return "Not Found";
+    case 413:
+        return "Payload Too Large";
+    case 503:
+        return "Service Unavailable";
+    default:
+        return "Internal Server Error";
+    }
+}
+
+// parse one request from the front of input, consumed is set to its length
+ParseResult parse_request(const std::string &input, HttpRequest &request,
+                          size_t &consumed) {
+    size_t header_end = input.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+        return input.size() > max_header_size ? ParseResult::TooLarge
+                                               : ParseResult::Incomplete;
+    }
+
+    size_t line_end = input.find("\r\n");
+    std::string line = input.substr(0, line_end);
+    size_t method_end = line.find(' ');
+    size_t target_end = line.find(' ', method_end + 1);
+    if (method_end == std::string::npos || target_end == std::string::npos) {
+        return ParseResult::Invalid;
+    }
+    request.method = line.substr(0, method_end);
+    std::string target =
+        line.substr(method_end + 1, target_end - method_end - 1);
+    request.version = line.substr(target_end + 1);
+
+    size_t query = target.find('?');
+    request.path = target.substr(0, query);
+    request.query =
+        query == std::string::npos ? "" : target.substr(query + 1);
+
+    request.headers.clear();
+    size_t position = line_end + 2;
+    while (position < header_end) {
+        size_t end = input.find("\r\n", position);
+        std::string header = input.substr(position, end - position);
+        size_t colon = header.find(':');
+        if (colon == std::string::npos) {
+            return ParseResult::Invalid;
+        }
+        request.headers[to_lower(trim(header.substr(0, colon)))] =
+            trim(header.substr(colon + 1));
+        position = end + 2;
+    }
+
+    size_t content_length = 0;
+    auto length = request.headers.find("content-length");
+    if (length != request.headers.end()) {
+        try {
+            content_length = std::stoull(length->second);
+        } catch (const std::exception &) {
+            return ParseResult::Invalid;
+        }
+    }
+    if (content_length > max_body_size) {
+        return ParseResult::TooLarge;
+    }
+
+    size_t body_start = header_end + 4;
+    if (input.size() < body_start + content_length) {
+        return ParseResult::Incomplete;
+    }
+    request.body = input.substr(body_start, content_length);
+    consumed = body_start + content_length;
+    return ParseResult::Complete;
+}
+
+} // namespace
+
+std::string HttpRequest::param(const std::string &key) const {
+    size_t start = 0;
+    while (start < query.size()) {
+        size_t end = query.find('&', start);
+        if (end == std::string::npos) {
+            end = query.size();
+        }
+        std::string pair = query.substr(start, end - start);
+        size_t equals = pair.find('=');
+        if (pair.substr(0, equals) == key) {
+            return equals == std::string::npos
+                       ? ""
+                       : url_decode(pair.substr(equals + 1));
+        }
+        start = end + 1;
+    }
+    return "";
+}
+
+bool HttpRequest::keep_alive() const {
+    auto connection = headers.find("connection");
+    std::string value =
+        connection == headers.end() ? "" : to_lower(connection->second);
+    if (version == "HTTP/1.0") {
+        return value == "keep-alive";
+    }
+    return value != "close";
+}
+
+std::string HttpResponse::serialize(const std::string &version,
+                                    bool keep_alive) const {
+    // HTTP/1.0 has no chunked encoding, a stream there ends when the
+    // connection closes
+    std::string length;
+    if (!stream) {
+        length = "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    } else if (version != "HTTP/1.0") {
+        length = "Transfer-Encoding: chunked\r\n";
+    } else {
+        keep_alive = false;
+    }
+    return "HTTP/1.1 " + std::to_string(status) + " " + status_text(status) +
+           "\r\n"
+           "Content-Type: " +
+           content_type +
+           "\r\n"
+           "Access-Control-Allow-Origin: *\r\n" +
+           length + "Connection: " + (keep_alive ? "keep-alive" : "close") +
+           "\r\n\r\n" + (stream ? "" : body);
+}
+
+HttpServer::HttpServer(int port, int worker_count, HttpHandler handler)
+    : port_(port), handler_(std::move(handler)),
+      worker_count_(std::max(1, worker_count)) {}
+
+HttpServer::~HttpServer() {
+    for (auto &[fd, connection] : connections_) {
+        close(fd);
+    }
+    if (event_fd_ != -1) {
+        close(event_fd_);
+    }
+    if (epoll_fd_ != -1) {
+        close(epoll_fd_);
+    }
+    if (server_socket_ != -1) {
+        close(server_socket_);
+    }
+}
+
+bool HttpServer::start() {
+    // descriptors are close-on-exec so stockfish processes spawned by the
+    // server do not hold client connections open
+    server_socket_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server_socket_ == -1) {
+        log_message(LogLevel::Error, "Failed to create socket");
+        return false;
+    }
+
+    int reuse = 1;
+    setsockopt(server_socket_, SOL_SOCKET, SO_REUSEADDR, &reuse,
+               sizeof(reuse));
+
+    sockaddr_in server_addr;
+    std::memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(port_);
+
+    if (bind(server_socket_, (struct sockaddr *)&server_addr,
+             sizeof(server_addr)) == -1) {
+        log_message(LogLevel::Error, "Failed to bind socket");
+        return false;
+    }
+
+    if (listen(server_socket_, SOMAXCONN) == -1) {
+        log_message(LogLevel::Error, "Failed to listen on socket");
+        return false;
+    }
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ == -1 || event_fd_ == -1 ||
+        !set_non_blocking(server_socket_)) {
+        log_message(LogLevel::Error, "Failed to set up event loop");
+        return false;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = server_socket_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, server_socket_, &event);
+    event.data.fd = event_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &event);
+
+    for (int i = 0; i < worker_count_; i++) {
+        workers_.emplace_back(&HttpServer::worker_loop, this);
+    }
+
+    return true;
+}
+
+void HttpServer::run() {
+    epoll_event events[max_events];
+    int64_t last_sweep = now_ms();
+
+    while (true) {
+        int count = epoll_wait(epoll_fd_, events, max_events, 1000);
+
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == server_socket_) {
+                accept_connections();
+                continue;
+            }
+            if (fd == event_fd_) {
+                drain_completions();
+                continue;
+            }
+
+            auto it = connections_.find(fd);
+            if (it == connections_.end()) {
+                continue;
+            }
+            Connection &connection = it->second;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                connection.peer_closed = true;
+            }
+            if (events[i].events & EPOLLOUT) {
+                write_connection(connection);
+            } else if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                read_connection(connection);
+            }
+        }
+
+        if (now_ms() - last_sweep >= 1000) {
+            expire_idle_connections();
+            last_sweep = now_ms();
+        }
+    }
+}
+
+void HttpServer::accept_connections() {
+    while (true) {
+        int fd = accept4(server_socket_, nullptr, nullptr,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                log_message(LogLevel::Error,
+                            "Failed to accept client connection");
+            }
+            return;
+        }
+        Connection &connection = connections_[fd];
+        connection = Connection();
+        connection.fd = fd;
+        connection.id = next_connection_id_++;
+        connection.last_active_ms = now_ms();
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+void HttpServer::read_connection(Connection &connection) {
+    char buffer[16 * 1024];
+    while (true) {
+        // enough for one request of the largest size, the parser rejects
+        // it once it sees that much
+        if (connection.input.size() >= max_header_size + max_body_size) {
+            break;
+        }
+        ssize_t bytes = read(connection.fd, buffer, sizeof(buffer));
+        if (bytes > 0) {
+            connection.input.append(buffer, bytes);
+            connection.last_active_ms = now_ms();
+            continue;
+        }
+        if (bytes == 0) {
+            connection.peer_closed = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            connection.peer_closed = true;
+        }
+        break;
+    }
+
+    if (connection.peer_closed) {
+        serve_closed(connection);
+        return;
+    }
+    process_input(connection);
+}
+
+void HttpServer::serve_closed(Connection &connection) {
+    // a half-closed socket can still be written to, so answer requests that
+    // arrived before the client's FIN
+    int fd = connection.fd;
+    process_input(connection);
+    auto it = connections_.find(fd);
+    if (it == connections_.end()) {
+        return;
+    }
+    if (!it->second.busy && it->second.output.empty()) {
+        close_connection(fd);
+        return;
+    }
+    // keep the fd open until the response is written so it is not reused
+    // by another connection
+    update_events(it->second);
+}
+
+void HttpServer::process_input(Connection &connection) {
+    if (connection.busy || !connection.output.empty()) {
+        return;
+    }
+
+    HttpRequest request;
+    size_t consumed = 0;
+    ParseResult result = parse_request(connection.input, request, consumed);
+    switch (result) {
+    case ParseResult::Incomplete:
+        return;
+    case ParseResult::Invalid:
+    case ParseResult::TooLarge: {
+        HttpResponse response;
+        response.status = result == ParseResult::TooLarge ? 413 : 400;
+        response.body = "{\"error\":\"Invalid request\"}";
+        connection.keep_alive = false;
+        connection.output = response.serialize("", false);
+        connection.output_offset = 0;
+        connection.input.clear();
+        write_connection(connection);
+        return;
+    }
+    case ParseResult::Complete:
+        break;
+    }
+
+    connection.input.erase(0, consumed);
+    connection.keep_alive = request.keep_alive();
+    connection.busy = true;
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex_);
+        jobs_.push_back({connection.fd, connection.id, std::move(request)});
+    }
+    jobs_ready_.notify_one();
+    // pipelined input waits in the socket until the response is written
+    update_events(connection);
+}
+
+void HttpServer::write_connection(Connection &connection) {
+    while (connection.output_offset < connection.output.size()) {
+        ssize_t bytes = send(
+            connection.fd, connection.output.data() + connection.output_offset,
+            connection.output.size() - connection.output_offset, MSG_NOSIGNAL);
+        if (bytes > 0) {
+            connection.output_offset += bytes;
+            connection.last_active_ms = now_ms();
+            continue;
+        }
+        if (bytes == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // wait until the socket is writable again
+            update_events(connection);
+            return;
+        }
+        close_connection(connection.fd);
+        return;
+    }
+    finish_response(connection);
+}
+
+void HttpServer::finish_response(Connection &connection) {
+    connection.output.clear();
+    connection.output_offset = 0;
+    connection.last_active_ms = now_ms();
+
+    if (connection.stream) {
+        release_stream(connection);
+        if (connection.busy) {
+            // the worker is still producing the rest of the response
+            update_events(connection);
+            return;
+        }
+        connection.stream.reset();
+    }
+    if (!connection.keep_alive) {
+        close_connection(connection.fd);
+        return;
+    }
+    if (connection.peer_closed) {
+        serve_closed(connection);
+        return;
+    }
+    update_events(connection);
+    // pipelined requests may already be buffered
+    process_input(connection);
+}
+
+void HttpServer::close_connection(int fd) {
+    auto it = connections_.find(fd);
+    if (it != connections_.end() && it->second.stream) {
+        close_stream(*it->second.stream);
+    }
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections_.erase(fd);
+}
+
+void HttpServer::update_events(const Connection &connection) {
+    epoll_event event{};
+    event.data.fd = connection.fd;
+    if (connection.output_offset < connection.output.size()) {
+        event.events = EPOLLOUT;
+    } else if (!connection.peer_closed && !connection.busy) {
+        event.events = EPOLLIN;
+    } else {
+        // nothing to read or write until a worker finishes, stop polling so
+        // hangups are not reported over and over and a client cannot queue
+        // up input while its request runs
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection.fd, nullptr);
+        return;
+    }
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event) == -1 &&
+        errno == ENOENT) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, connection.fd, &event);
+    }
+}
+
+void HttpServer::close_stream(Stream &stream) {
+    {
+        std::lock_guard<std::mutex> lock(stream.mutex);
+        stream.closed = true;
+    }
+    stream.drained.notify_all();
+}
+
+void HttpServer::release_stream(Connection &connection) {
+    {
+        std::lock_guard<std::mutex> lock(connection.stream->mutex);
+        connection.stream->queued -= connection.stream_bytes;
+    }
+    connection.stream->drained.notify_all();
+    connection.stream_bytes = 0;
+}
+
+void HttpServer::drain_completions() {
+    uint64_t value;
+    while (read(event_fd_, &value, sizeof(value)) > 0) {
+    }
+
+    std::vector<Completion> completions;
+    {
+        std::lock_guard<std::mutex> lock(completions_mutex_);
+        completions.swap(completions_);
+    }
+
+    for (auto &completion : completions) {
+        auto it = connections_.find(completion.fd);
+        if (it == connections_.end() ||
+            it->second.id != completion.connection) {
+            // closed while streaming
+            if (completion.stream) {
+                close_stream(*completion.stream);
+            }
+            continue;
+        }
+        Connection &connection = it->second;
+        if (completion.last) {
+            connection.busy = false;
+        }
+        connection.keep_alive = completion.keep_alive;
+        if (completion.stream) {
+            connection.stream = completion.stream;
+            // the final chunk is not counted against the queue
+            if (!completion.last) {
+                connection.stream_bytes += completion.response.size();
+            }
+        }
+        // earlier parts of a streamed response may still be unwritten
+        if (connection.output_offset > 0) {
+            connection.output.erase(0, connection.output_offset);
+            connection.output_offset = 0;
+        }
+        connection.output += completion.response;
+        write_connection(connection);
+    }
+}
+
+void HttpServer::expire_idle_connections() {
+    int64_t cutoff = now_ms() - idle_timeout_ms;
+    std::vector<int> expired;
+    for (const auto &[fd, connection] : connections_) {
+        // a streaming connection is busy, it expires when its client stops
+        // reading so the worker feeding it is released
+        bool idle = !connection.busy && connection.output.empty();
+        bool stalled = connection.stream &&
+                       connection.output_offset < connection.output.size();
+        if ((idle || stalled) && connection.last_active_ms < cutoff) {
+            expired.push_back(fd);
+        }
+    }
+    for (int fd : expired) {
+        close_connection(fd);
+    }
+}
+
+void HttpServer::worker_loop() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(jobs_mutex_);
+            jobs_ready_.wait(lock, [this]() { return !jobs_.empty(); });
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        HttpResponse response;
+        try {
+            response = handler_(job.request);
+        } catch (const std::exception &e) {
+            log_message(LogLevel::Error, e.what());
+            response.status = 500;
+            response.body = "{\"error\":\"Internal server error\"}";
+        }
+
+        bool keep_alive = job.request.keep_alive();
+        if (response.stream) {
+            stream_response(job, response, keep_alive);
+            continue;
+        }
+        post({job.fd, job.connection,
+              response.serialize(job.request.version, keep_alive), keep_alive,
+              true, nullptr});
+    }
+}
+
+void HttpServer::stream_response(const Job &job, const HttpResponse &response,
+                                 bool keep_alive) {
+    auto stream = std::make_shared<Stream>();
+    bool chunked = job.request.version != "HTTP/1.0";
+    keep_alive = keep_alive && chunked;
+    bool open =
+        send_chunk(job, stream,
+                   response.serialize(job.request.version, keep_alive),
+                   keep_alive);
+
+    std::string buffer;
+    auto flush = [&]() {
+        if (open && !buffer.empty() && chunked) {
+            char size[32];
+            snprintf(size, sizeof(size), "%zx\r\n", buffer.size());
+            open = send_chunk(job, stream, size + buffer + "\r\n", keep_alive);
+        } else if (open && !buffer.empty()) {
+            open = send_chunk(job, stream, std::move(buffer), keep_alive);
+        }
+        buffer.clear();
+        return open;
+    };
+    StreamWriter write = [&](const std::string &data) {
+        buffer += data;
+        return buffer.size() < stream_chunk_size || flush();
+    };
+
+    bool failed = false;
+    try {
+        response.stream(write);
+    } catch (const std::exception &e) {
+        log_message(LogLevel::Error, e.what());
+        failed = true;
+    }
+    flush();
+    // always posted so the event loop marks the connection idle again. the
+    // status is already sent, so a failed stream ends by closing the
+    // connection without the last chunk, which HTTP/1.1 clients see as
+    // truncated.
+    if (failed) {
+        post({job.fd, job.connection, "", false, true, stream});
+    } else {
+        post({job.fd, job.connection, open && chunked ? "0\r\n\r\n" : "",
+              open && keep_alive, true, stream});
+    }
+}
+
+bool HttpServer::send_chunk(const Job &job,
+                            const std::shared_ptr<Stream> &stream,
+                            std::string data, bool keep_alive) {
+    {
+        std::unique_lock<std::mutex> lock(stream->mutex);
+        bool ready =
+            stream->drained.wait_for(lock, stream_stall_timeout, [&]() {
+                return stream->closed || stream->queued < max_stream_queued;
+            });
+        if (!ready || stream->closed) {
+            return false;
+        }
+        stream->queued += data.size();
+    }
+    post({job.fd, job.connection, std::move(data), keep_alive, false, stream});
+    return true;
+}
+
+void HttpServer::post(Completion completion) {
+    {
+        std::lock_guard<std::mutex> lock(completions_mutex_);
+        completions_.push_back(std::move(completion));
+    }
+    uint64_t value = 1;
+    write(event_fd_, &value, sizeof(value));
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct HttpRequest {
+    std::string method;
+    std::string path;
+    std::string query;
+    std::string version;
+    // header names are lowercased
+    std::unordered_map<std::string, std::string> headers;
+    std::string body;
+
+    // value of a query parameter, empty if missing
+    std::string param(const std::string &key) const;
+    bool keep_alive() const;
+};
+
+// passes part of a streamed body to the client, false once it is gone
+using StreamWriter = std::function<bool(const std::string &data)>;
+
+struct HttpResponse {
+    int status = 200;
+    std::string content_type = "application/json";
+    std::string body;
+    // when set, the body is sent as the worker calls stream, which hands it
+    // to the writer piece by piece. HTTP/1.1 clients get chunked transfer
+    // encoding, HTTP/1.0 clients read until the connection closes. the writer
+    // blocks while too much output is waiting to be sent. stream runs before
+    // the request is released, so it may refer to the request.
+    std::function<void(const StreamWriter &write)> stream;
+
+    // status line and headers for a request of the given HTTP version,
+    // followed by the body unless streaming
+    std::string serialize(const std::string &version, bool keep_alive) const;
+};
+
+using HttpHandler = std::function<HttpResponse(const HttpRequest &)>;
+
+// non-blocking HTTP/1.1 server. one thread runs an epoll loop that accepts
+// connections, parses requests incrementally and writes responses, complete
+// requests are handled by a fixed pool of worker threads. each connection
+// has at most one request in flight so responses stay in order.
+class HttpServer {
+  public:
+    HttpServer(int port, int worker_count, HttpHandler handler);
+    ~HttpServer();
+
+    // bind and listen, false on failure
+    bool start();
+    // run the event loop, never returns
+    void run();
+
+  private:
+    // flow control between a worker streaming a response and the event loop
+    struct Stream {
+        std::mutex mutex;
+        std::condition_variable drained;
+        // bytes handed to the event loop and not yet written
+        size_t queued = 0;
+        // the connection is gone, the worker should stop
+        bool closed = false;
+    };
+
+    struct Connection {
+        int fd;
+        // distinguishes connections that reuse a closed connection's fd
+        uint64_t id = 0;
+        std::string input;
+        std::string output;
+        size_t output_offset = 0;
+        // a request is being handled by a worker
+        bool busy = false;
+        bool keep_alive = true;
+        // the client closed its side, close once buffered requests are
+        // answered
+        bool peer_closed = false;
+        int64_t last_active_ms = 0;
+        // the response being streamed and how much of output came from it
+        std::shared_ptr<Stream> stream;
+        size_t stream_bytes = 0;
+    };
+
+    struct Job {
+        int fd;
+        uint64_t connection;
+        HttpRequest request;
+    };
+
+    // a response, or part of a streamed one, ready to be written
+    struct Completion {
+        int fd;
+        uint64_t connection;
+        std::string response;
+        bool keep_alive;
+        // false while more of a streamed response will follow
+        bool last = true;
+        std::shared_ptr<Stream> stream;
+    };
+
+    void accept_connections();
+    void read_connection(Connection &connection);
+    // start handling the next buffered request if the connection is idle
+    void process_input(Connection &connection);
+    // the client closed its side: answer what it sent, then close
+    void serve_closed(Connection &connection);
+    void write_connection(Connection &connection);
+    void finish_response(Connection &connection);
+    void close_connection(int fd);
+    void drain_completions();
+    void expire_idle_connections();
+    void update_events(const Connection &connection);
+    static void close_stream(Stream &stream);
+    // give the worker credit for stream output that has been written
+    void release_stream(Connection &connection);
+    void worker_loop();
+    void stream_response(const Job &job, const HttpResponse &response,
+                         bool keep_alive);
+    // wait for room in the stream's queue, false if the connection is gone
+    bool send_chunk(const Job &job, const std::shared_ptr<Stream> &stream,
+                    std::string data, bool keep_alive);
+    void post(Completion completion);
+
+    int port_;
+    HttpHandler handler_;
+    int server_socket_ = -1;
+    int epoll_fd_ = -1;
+    // wakes the event loop when workers finish requests
+    int event_fd_ = -1;
+    std::unordered_map<int, Connection> connections_;
+    uint64_t next_connection_id_ = 0;
+
+    std::mutex jobs_mutex_;
+    std::condition_variable jobs_ready_;
+    std::deque<Job> jobs_;
+
+    std::mutex completions_mutex_;
+    std::vector<Completion> completions_;
+
+    std::vector<std::thread> workers_;
+    int worker_count_;
+};
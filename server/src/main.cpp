@@ -1,170 +1,300 @@
 #include "engine.h"
+#include "http_server.h"
+#include "log.h"
+#include "session.h"
 #include "stockfish.h"
-#include <iostream>
-#include <netinet/in.h>
-#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
-#include <unistd.h>
 #include <vector>
 
-void handle_make_move(int client_socket, std::string move) {
+const int default_search_time_ms = 1000;
+// no request may search longer than this, whatever depth it asks for
+const int max_search_time_ms = 30000;
+const int stockfish_processes = 2;
+// native searches between transposition table statistics in the info log
+const uint64_t table_stats_interval = 100;
+
+SessionTable sessions;
+// native search threads per request unless asked for more, at most
+// max_search_threads. extra threads come from a budget of one per core
+// shared by all searches and /analyze batches, so a request that asks for
+// more while the cores are busy gets fewer, down to one.
+int search_threads = 1;
+int max_search_threads = 1;
+UciEnginePool stockfish("stockfish", stockfish_processes);
+std::atomic<uint64_t> native_searches{0};
+
+HttpResponse json_response(int status, const std::string &body) {
+    HttpResponse response;
+    response.status = status;
+    response.body = body;
+    return response;
+}
+
+HttpResponse handle_make_move(GameSession &session, std::string move) {
     if (move.empty()) {
-        std::string response =
-            "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
-        send(client_socket, response.c_str(), response.length(), 0);
-        close(client_socket);
-        return;
+        return json_response(400, "{\"error\":\"Missing move\"}");
     }
 
-    if (!act(move)) {
-        std::string response = "HTTP/1.1 400 Bad Request\r\n"
-                               "Content-Type: application/json\r\n"
-                               "Access-Control-Allow-Origin: *\r\n"
-                               "Content-Length: " +
-                               std::to_string(26 + move.size()) +
-                               "\r\n"
-                               "\r\n{\"error\":\"Illegal move: " +
-                               move + "\"}";
-
-        send(client_socket, response.c_str(), response.length(), 0);
-        close(client_socket);
-        return;
+    std::lock_guard<std::mutex> lock(session.mutex_);
+    if (!session.act(move)) {
+        return json_response(400,
+                             "{\"error\":\"Illegal move: " + move + "\"}");
     }
 
-    const std::string response =
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: application/json\r\n"
-        "Access-Control-Allow-Origin: *\r\n"
-        "\r\n"
-        "{\"board\":\"" +
-        get_board() + "\",\"isCheck\":" + std::to_string(is_check()) + "}";
+    return json_response(200, "{\"board\":\"" + session.get_board() +
+                                  "\",\"isCheck\":" +
+                                  std::to_string(session.is_check()) + "}");
+}
+
+HttpResponse handle_reset(std::string old_id) {
+    if (!old_id.empty()) {
+        sessions.remove(old_id);
+    }
+    const std::string id = sessions.create();
+    log_message(LogLevel::Debug, "reset " + id);
 
-    send(client_socket, response.c_str(), response.size(), 0);
-    close(client_socket);
+    return json_response(200, "{\"id\":\"" + id + "\"}");
 }
 
-void handle_reset(int client_socket) {
-    std::cout << "reset" << std::endl;
-    reset_engine();
-    const std::string response = "HTTP/1.1 200 OK\r\n"
-                                 "Content-Type: text/plain\r\n"
-                                 "Content-Length: 2\r\n"
-                                 "Access-Control-Allow-Origin: *\r\n"
-                                 "\r\n"
-                                 "OK";
-
-    send(client_socket, response.c_str(), response.size(), 0);
-    close(client_socket);
+// hit rate since startup and how much of the table the current generation
+// fills, logged after the first native search and then every
+// table_stats_interval searches
+void log_table_stats() {
+    uint64_t searches =
+        native_searches.fetch_add(1, std::memory_order_relaxed);
+    if (searches % table_stats_interval != 0) {
+        return;
+    }
+    TTStats stats = transposition_table->stats();
+    char message[128];
+    snprintf(message, sizeof(message),
+             "transposition table: %.1f%% hits of %llu probes, hashfull %d",
+             stats.probes ? 100.0 * stats.hits / stats.probes : 0.0,
+             static_cast<unsigned long long>(stats.probes), stats.hashfull);
+    log_message(LogLevel::Info, message);
 }
 
-void handle_genmove(int client_socket) {
-    std::vector<std::string> moves_string;
-    for (const auto &move : moves) {
-        moves_string.push_back(move.to_string());
+HttpResponse handle_genmove(GameSession &session, const std::string &id,
+                            std::string engine, SearchLimits limits,
+                            UciLimits uci_limits) {
+    std::lock_guard<std::mutex> lock(session.mutex_);
+    if (session.get_legal_moves().empty()) {
+        return json_response(400, "{\"error\":\"Game is over\"}");
+    }
+
+    std::string move;
+    if (engine == "stockfish") {
+        std::vector<std::string> moves_string;
+        for (const auto &move : session.moves_) {
+            moves_string.push_back(move.to_string());
+        }
+        try {
+            move = stockfish.best_move(id, moves_string, uci_limits);
+        } catch (const std::exception &e) {
+            log_message(LogLevel::Error, e.what());
+            return json_response(503, "{\"error\":\"Engine unavailable\"}");
+        }
+    } else {
+        move = session.generate_move(limits).to_string();
+        log_table_stats();
+    }
+    if (!session.act(move)) {
+        log_message(LogLevel::Error, "engine played illegal move " + move);
+        return json_response(
+            500, "{\"error\":\"Engine returned an illegal move\"}");
     }
-    const std::string move = generate_move_stockfish(moves_string);
-    act(move);
 
-    const std::string response =
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: application/json\r\n"
-        "Access-Control-Allow-Origin: *\r\n"
-        "\r\n{\"move\":\"" +
-        move + "\",\"board\":\"" + get_board() +
-        "\",\"isCheck\":" + std::to_string(is_check()) + "}";
+    return json_response(200, "{\"move\":\"" + move + "\",\"board\":\"" +
+                                  session.get_board() + "\",\"isCheck\":" +
+                                  std::to_string(session.is_check()) + "}");
+}
 
-    send(client_socket, response.c_str(), response.size(), 0);
-    close(client_socket);
+HttpResponse handle_game(GameSession &session) {
+    std::lock_guard<std::mutex> lock(session.mutex_);
+    return json_response(
+        200, "{ \"gameState\": \"" + session.get_game_state() + "\" }");
 }
 
-void start_server(int port) {
-    int server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_socket == -1) {
-        std::cerr << "Failed to create socket" << std::endl;
-        return;
+std::string json_escape(const std::string &value) {
+    std::string escaped;
+    for (unsigned char c : value) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
     }
+    return escaped;
+}
 
-    sockaddr_in server_addr;
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(port);
-
-    if (bind(server_socket, (struct sockaddr *)&server_addr,
-             sizeof(server_addr)) == -1) {
-        std::cerr << "Failed to bind socket" << std::endl;
-        close(server_socket);
-        return;
+std::string analysis_json(const PositionAnalysis &analysis) {
+    std::string json = "{\"index\":" + std::to_string(analysis.index) +
+                       ",\"fen\":\"" + json_escape(analysis.fen) + "\"";
+    if (!analysis.error.empty()) {
+        return json + ",\"error\":\"" + json_escape(analysis.error) + "\"}";
     }
-
-    if (listen(server_socket, 10) == -1) {
-        std::cerr << "Failed to listen on socket" << std::endl;
-        close(server_socket);
-        return;
+    json += ",\"isCheck\":" + std::to_string(analysis.check) +
+            ",\"gameState\":\"" + game_state_name(analysis.state) +
+            "\",\"moves\":[";
+    for (int i = 0; i < analysis.legal_moves.size(); i++) {
+        json += (i ? ",\"" : "\"") + analysis.legal_moves[i].to_string() + "\"";
     }
+    return json + "]}";
+}
 
-    try {
-        init_engine();
-    } catch (const std::exception &e) {
-        std::cerr << e.what() << std::endl;
-        close(server_socket);
-        return;
+// the body holds one fen per line, the response streams one json object per
+// position in the same order. the body is buffered like any other, so a
+// batch is limited to the 16 MB request size, only the output is streamed.
+HttpResponse handle_analyze(const HttpRequest &request) {
+    int threads = max_search_threads;
+    std::string threads_param = request.param("threads");
+    if (!threads_param.empty()) {
+        threads =
+            std::clamp(std::atoi(threads_param.c_str()), 1, max_search_threads);
     }
 
-    std::cout << "Server is listening on port " << port << std::endl;
+    HttpResponse response;
+    response.content_type = "application/x-ndjson";
+    response.stream = [&request, threads](const StreamWriter &write) {
+        const std::string &body = request.body;
+        size_t position = 0;
+        auto next = [&](std::string &fen) {
+            while (position < body.size()) {
+                size_t end = body.find('\n', position);
+                if (end == std::string::npos) {
+                    end = body.size();
+                }
+                fen = body.substr(position, end - position);
+                position = end + 1;
+                if (!fen.empty() && fen.back() == '\r') {
+                    fen.pop_back();
+                }
+                if (!fen.empty()) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        analyze_positions(
+            next,
+            [&](const PositionAnalysis &analysis) {
+                return write(analysis_json(analysis) + "\n");
+            },
+            threads);
+    };
+    return response;
+}
 
-    while (true) {
-        int client_socket = accept(server_socket, nullptr, nullptr);
-        if (client_socket == -1) {
-            std::cerr << "Failed to accept client connection" << std::endl;
-            continue;
-        }
+HttpResponse handle_request(const HttpRequest &request) {
+    if (request.method == "POST" && request.path == "/analyze") {
+        return handle_analyze(request);
+    }
+    if (request.method != "GET") {
+        return json_response(404, "");
+    }
 
-        char buffer[1024] = {0};
-        read(client_socket, buffer, 1024);
+    if (request.path == "/reset") {
+        return handle_reset(request.param("id"));
+    }
 
-        std::string request(buffer);
+    if (request.path != "/genmove" && request.path != "/make_move" &&
+        request.path != "/game") {
+        return json_response(404, "");
+    }
 
-        if (request.find("GET /genmove") != std::string::npos) {
-            std::thread(handle_genmove, client_socket).detach();
-        } else if (request.find("GET /make_move") != std::string::npos) {
-            std::string query = request.substr(request.find("?") + 1);
-            std::string move;
+    const std::string id = request.param("id");
+    std::shared_ptr<GameSession> session = sessions.find(id);
+    if (!session) {
+        return json_response(404, "{\"error\":\"Unknown game\"}");
+    }
 
-            if (query.find("move=") != std::string::npos) {
-                size_t start = query.find("move=") + 5;
-                size_t end = query.find(' ', start);
-                move = query.substr(start, end - start);
+    if (request.path == "/genmove") {
+        SearchLimits limits;
+        UciLimits uci_limits;
+        limits.time_ms = default_search_time_ms;
+        limits.threads = search_threads;
+        std::string depth = request.param("depth");
+        std::string movetime = request.param("movetime");
+        std::string threads = request.param("threads");
+        if (!depth.empty()) {
+            limits.depth = std::atoi(depth.c_str());
+            if (limits.depth <= 0) {
+                return json_response(400, "{\"error\":\"Invalid depth\"}");
             }
-            std::thread(handle_make_move, client_socket, move).detach();
-        } else if (request.find("GET /reset") != std::string::npos) {
-            std::thread(handle_reset, client_socket).detach();
-        } else if (request.find("GET /game") != std::string::npos) {
-            std::string response =
-                "HTTP/1.1 200 OK\r\n"
-                "Content-Type: application/json\r\n"
-                "Access-Control-Allow-Origin: *\r\n"
-                "Content-Length: " +
-                std::to_string(get_game_state().length() + 19) +
-                "\r\n\r\n"
-                "{ \"gameState\": \"" +
-                get_game_state() + "\" }";
-
-            send(client_socket, response.c_str(), response.length(), 0);
-            close(client_socket);
-        } else {
-            std::string response =
-                "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
-            send(client_socket, response.c_str(), response.length(), 0);
-            close(client_socket);
+            limits.time_ms = max_search_time_ms;
+            uci_limits.depth = limits.depth;
+        }
+        if (!movetime.empty()) {
+            limits.time_ms = std::atoi(movetime.c_str());
+            if (limits.time_ms <= 0) {
+                return json_response(400, "{\"error\":\"Invalid movetime\"}");
+            }
+            limits.time_ms = std::min(limits.time_ms, max_search_time_ms);
+            uci_limits.movetime_ms = limits.time_ms;
         }
+        if (!threads.empty()) {
+            limits.threads =
+                std::clamp(std::atoi(threads.c_str()), 1, max_search_threads);
+        }
+        return handle_genmove(*session, id, request.param("engine"), limits,
+                              uci_limits);
+    } else if (request.path == "/make_move") {
+        return handle_make_move(*session, request.param("move"));
     }
-
-    close(server_socket);
+    return handle_game(*session);
 }
 
-int main() {
+// usage: server [--log-level debug|info|warning|error|off]
+int main(int argc, char *argv[]) {
     int port = 4000;
-    start_server(port);
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        LogLevel level;
+        if (arg == "--log-level" && i + 1 < argc &&
+            parse_log_level(argv[i + 1], level)) {
+            set_log_level(level);
+            i++;
+        } else {
+            log_message(LogLevel::Error, "unknown argument " + arg);
+            return 1;
+        }
+    }
+    int workers = std::max(4u, std::thread::hardware_concurrency());
+    max_search_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // writes to a crashed engine process must not kill the server
+    std::signal(SIGPIPE, SIG_IGN);
+
+    try {
+        init_engine();
+    } catch (const std::exception &e) {
+        log_message(LogLevel::Error, e.what());
+        return 1;
+    }
+    log_message(LogLevel::Info,
+                "evaluation: " + (network_loaded() ? default_network_file
+                                                   : std::string("classical")));
+
+    HttpServer server(port, workers, handle_request);
+    if (!server.start()) {
+        return 1;
+    }
+
+    log_message(LogLevel::Info,
+                "Server is listening on port " + std::to_string(port));
+    server.run();
     return 0;
 }
@@ -0,0 +1,165 @@
+#include "engine.h"
+#include "perft.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+const int default_suite_depth = 4;
+const int default_hash_mb = 64;
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+}
+
+void print_speed(uint64_t nodes, double seconds) {
+    std::cout << nodes << " nodes in " << seconds << " s ("
+              << static_cast<uint64_t>(nodes / std::max(seconds, 1e-9))
+              << " nodes/s)" << std::endl;
+}
+
+// run every suite position to the given depth, return false on mismatch
+bool run_suite(int max_depth, int threads, PerftTable *table) {
+    bool passed = true;
+    uint64_t total_nodes = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (const auto &position : perft_suite) {
+        int depth = std::min<int>(max_depth, position.nodes.size());
+        ChessBoard board(position.fen);
+
+        auto position_start = std::chrono::steady_clock::now();
+        uint64_t nodes = perft_parallel(board, depth, threads, table);
+        double seconds = seconds_since(position_start);
+        uint64_t expected = position.nodes[depth - 1];
+        total_nodes += nodes;
+
+        std::cout << (nodes == expected ? "ok    " : "FAIL  ")
+                  << position.name << " depth " << depth << ": ";
+        print_speed(nodes, seconds);
+        if (nodes != expected) {
+            std::cout << "      expected " << expected << std::endl;
+            passed = false;
+        }
+    }
+
+    std::cout << "total: ";
+    print_speed(total_nodes, seconds_since(start));
+    return passed;
+}
+
+const char *slider_indexing_name(SliderIndexing indexing) {
+    return indexing == SliderIndexing::Pext ? "pext" : "magic";
+}
+
+// run the suite once per slider attack indexing and compare their speed
+bool compare_sliders(int depth, int threads, int hash_mb) {
+    std::vector<SliderIndexing> variants = {SliderIndexing::Magic};
+    if (pext_supported()) {
+        variants.push_back(SliderIndexing::Pext);
+    } else {
+        std::cout << "pext is not supported on this cpu" << std::endl;
+    }
+
+    bool passed = true;
+    std::vector<double> times;
+    for (auto indexing : variants) {
+        set_slider_indexing(indexing);
+        std::cout << slider_indexing_name(indexing) << ":" << std::endl;
+        // a fresh table per run so neither starts with cached counts
+        std::unique_ptr<PerftTable> table;
+        if (hash_mb > 0) {
+            table = std::make_unique<PerftTable>(hash_mb);
+        }
+        auto start = std::chrono::steady_clock::now();
+        passed &= run_suite(depth, threads, table.get());
+        times.push_back(seconds_since(start));
+    }
+
+    if (times.size() == 2) {
+        std::cout << "pext speedup over magic: " << times[0] / times[1] << "x"
+                  << std::endl;
+    }
+    return passed;
+}
+
+// usage:
+//   perft [suite [depth]] [--threads n] [--hash mb] [--sliders magic|pext]
+//   perft sliders [depth] [--threads n] [--hash mb]
+//   perft <depth> [fen] [--threads n] [--hash mb] [--sliders magic|pext]
+//   perft divide <depth> [fen] [--hash mb] [--sliders magic|pext]
+int main(int argc, char *argv[]) {
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int hash_mb = default_hash_mb;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--hash" && i + 1 < argc) {
+            hash_mb = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--sliders" && i + 1 < argc) {
+            SliderIndexing wanted = std::string(argv[++i]) == "pext"
+                                        ? SliderIndexing::Pext
+                                        : SliderIndexing::Magic;
+            if (set_slider_indexing(wanted) != wanted) {
+                std::cerr << "pext is not supported on this cpu" << std::endl;
+            }
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    init_engine();
+    std::string command = args.empty() ? "suite" : args[0];
+    if (command == "sliders") {
+        int depth =
+            args.size() > 1 ? std::atoi(args[1].c_str()) : default_suite_depth;
+        return compare_sliders(std::max(depth, 1), threads, hash_mb) ? 0 : 1;
+    }
+
+    std::cout << "sliders: " << slider_indexing_name(get_slider_indexing())
+              << std::endl;
+    std::unique_ptr<PerftTable> table;
+    if (hash_mb > 0) {
+        table = std::make_unique<PerftTable>(hash_mb);
+    }
+
+    if (command == "suite") {
+        int depth =
+            args.size() > 1 ? std::atoi(args[1].c_str()) : default_suite_depth;
+        return run_suite(std::max(depth, 1), threads, table.get()) ? 0 : 1;
+    }
+
+    bool split = command == "divide";
+    size_t arg = split ? 1 : 0;
+    if (args.size() <= arg || std::atoi(args[arg].c_str()) < 1) {
+        std::cerr << "usage: perft [suite [depth]] | sliders [depth] | "
+                     "[divide] <depth> [fen] [--threads n] [--hash mb] "
+                     "[--sliders magic|pext]"
+                  << std::endl;
+        return 1;
+    }
+    int depth = std::atoi(args[arg].c_str());
+    ChessBoard board(args.size() > arg + 1 ? args[arg + 1] : starting_fen);
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t nodes = 0;
+    if (split) {
+        for (const auto &[move, count] : divide(board, depth, table.get())) {
+            std::cout << move.to_string() << ": " << count << std::endl;
+            nodes += count;
+        }
+    } else {
+        nodes = perft_parallel(board, depth, threads, table.get());
+    }
+    print_speed(nodes, seconds_since(start));
+
+    return 0;
+}
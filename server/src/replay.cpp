@@ -0,0 +1,59 @@
+#include "pgn.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// replay every game of the given PGN files, reporting malformed games and
+// the replay speed
+// usage: replay [--threads n] file.pgn...
+int main(int argc, char *argv[]) {
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            threads = std::max(1, std::atoi(argv[++i]));
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty()) {
+        std::cerr << "usage: replay [--threads n] file.pgn..." << std::endl;
+        return 1;
+    }
+
+    ReplayStats total;
+    bool opened = true;
+    for (const auto &file : files) {
+        MappedFile input;
+        if (!input.open(file)) {
+            std::cerr << file << ": cannot open" << std::endl;
+            opened = false;
+            continue;
+        }
+        ReplayStats stats = replay_pgn(
+            input.data(), input.size(), threads, [&](const PgnError &error) {
+                std::cerr << file << ":" << error.line << ": "
+                          << error.message << std::endl;
+            });
+        std::cout << file << ": " << stats.games << " games, "
+                  << stats.malformed << " malformed, " << stats.moves
+                  << " moves in " << stats.seconds << " s" << std::endl;
+        total.games += stats.games;
+        total.malformed += stats.malformed;
+        total.moves += stats.moves;
+        total.seconds += stats.seconds;
+    }
+
+    double seconds = std::max(total.seconds, 1e-9);
+    std::cout << "total: " << total.games << " games, " << total.malformed
+              << " malformed, " << total.moves << " moves in "
+              << total.seconds << " s ("
+              << static_cast<uint64_t>(total.games / seconds) << " games/s, "
+              << static_cast<uint64_t>(total.moves / seconds) << " moves/s)"
+              << std::endl;
+    return opened ? 0 : 1;
+}
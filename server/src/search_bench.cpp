@@ -0,0 +1,106 @@
+#include "engine.h"
+#include "nnue.h"
+#include "perft.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+const int default_bench_depth = 7;
+
+struct BenchResult {
+    double seconds = 0;
+    uint64_t nodes = 0;
+    uint64_t probes = 0;
+    uint64_t hits = 0;
+    uint64_t pawn_probes = 0;
+    uint64_t pawn_hits = 0;
+};
+
+// search every suite position to a fixed depth from an empty table
+BenchResult run_bench(int depth, int threads, TranspositionTable &table) {
+    BenchResult total;
+    for (const auto &position : perft_suite) {
+        ChessBoard board(position.fen);
+        SearchLimits limits;
+        limits.depth = depth;
+        limits.threads = threads;
+        table.clear();
+
+        auto start = std::chrono::steady_clock::now();
+        SearchResult result = search(board, limits, &table);
+        double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+        std::cout << "  " << position.name << ": "
+                  << result.best_move.to_string() << " score "
+                  << result.score << ", " << result.nodes << " nodes in "
+                  << seconds << " s" << std::endl;
+        TTStats stats = table.stats();
+        total.seconds += seconds;
+        total.nodes += result.nodes;
+        total.probes += stats.probes;
+        total.hits += stats.hits;
+        total.pawn_probes += result.pawn_probes;
+        total.pawn_hits += result.pawn_hits;
+    }
+    return total;
+}
+
+void print_total(const BenchResult &result) {
+    std::cout << "total: " << result.nodes << " nodes in " << result.seconds
+              << " s ("
+              << static_cast<uint64_t>(result.nodes /
+                                       std::max(result.seconds, 1e-9))
+              << " nodes/s), table hit rate "
+              << 100.0 * result.hits / std::max<uint64_t>(result.probes, 1)
+              << "%, pawn table hit rate "
+              << 100.0 * result.pawn_hits /
+                     std::max<uint64_t>(result.pawn_probes, 1)
+              << "%" << std::endl;
+}
+
+// usage: search_bench [depth] [--threads n] [--hash mb] [--network file]
+// compares time to depth of one thread against n lazy smp threads, using the
+// network evaluation when the file loads
+int main(int argc, char *argv[]) {
+    int depth = default_bench_depth;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int hash_mb = default_transposition_mb;
+    std::string network_file = default_network_file;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--hash" && i + 1 < argc) {
+            hash_mb = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--network" && i + 1 < argc) {
+            network_file = argv[++i];
+        } else {
+            depth = std::max(1, std::atoi(arg.c_str()));
+        }
+    }
+
+    init_engine(hash_mb, network_file);
+    TranspositionTable &table = *transposition_table;
+    std::cout << "evaluation: "
+              << (network_loaded() ? network_file : std::string("classical"))
+              << std::endl;
+
+    std::cout << "1 thread, depth " << depth << std::endl;
+    BenchResult single = run_bench(depth, 1, table);
+    print_total(single);
+
+    std::cout << threads << " threads, depth " << depth << std::endl;
+    BenchResult parallel = run_bench(depth, threads, table);
+    print_total(parallel);
+
+    std::cout << "speedup: "
+              << single.seconds / std::max(parallel.seconds, 1e-9) << "x"
+              << std::endl;
+    return 0;
+}
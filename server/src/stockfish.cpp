@@ -1,51 +1,236 @@
 #include "stockfish.h"
-#include <array>
-#include <cstdio>
-#include <iostream>
-#include <memory>
-#include <sstream>
+#include "log.h"
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
 #include <stdexcept>
-#include <sys/socket.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
-std::string generate_move_stockfish(std::vector<std::string> &moves) {
-    std::string input = "position startpos moves";
-    for (const auto &move : moves) {
-        input += " " + move;
+extern char **environ;
+
+namespace {
+
+const int handshake_timeout_ms = 5000;
+// extra time an engine gets to answer "stop" before it is restarted
+const int stop_grace_ms = 1000;
+
+int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+} // namespace
+
+UciEnginePool::UciEnginePool(std::string command, int size)
+    : command_(std::move(command)) {
+    // processes are started lazily on their first request
+    for (int i = 0; i < size; i++) {
+        idle_.push_back(std::make_unique<Process>());
     }
+}
 
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen("stockfish", "r+"),
-                                                  pclose);
-    if (!pipe) {
-        throw std::runtime_error("popen() failed!");
+UciEnginePool::~UciEnginePool() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &process : idle_) {
+        stop(*process);
     }
+}
 
-    fprintf(pipe.get(), "%s\n", input.c_str());
-    fflush(pipe.get());
+bool UciEnginePool::start(Process &process) {
+    int to_engine[2];
+    int from_engine[2];
+    // close-on-exec so other engines do not inherit this one's pipes, dup2
+    // clears the flag on the child's stdin and stdout
+    if (pipe2(to_engine, O_CLOEXEC) == -1) {
+        return false;
+    }
+    if (pipe2(from_engine, O_CLOEXEC) == -1) {
+        close(to_engine[0]);
+        close(to_engine[1]);
+        return false;
+    }
 
-    fprintf(pipe.get(), "go depth 20\n");
-    fflush(pipe.get());
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, to_engine[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, from_engine[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, to_engine[1]);
+    posix_spawn_file_actions_addclose(&actions, from_engine[0]);
 
-    std::array<char, 128> buffer;
-    std::string result;
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-        result += buffer.data();
-        if (result.find("bestmove") != std::string::npos) {
-            break;
+    char *argv[] = {const_cast<char *>(command_.c_str()), nullptr};
+    int result = posix_spawnp(&process.pid, command_.c_str(), &actions,
+                              nullptr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(to_engine[0]);
+    close(from_engine[1]);
+
+    if (result != 0) {
+        close(to_engine[1]);
+        close(from_engine[0]);
+        process.pid = -1;
+        return false;
+    }
+    process.input = to_engine[1];
+    process.output = from_engine[0];
+    process.buffer.clear();
+    process.game.clear();
+
+    std::string line;
+    if (!send(process, "uci") ||
+        !wait_for(process, "uciok", handshake_timeout_ms, line) ||
+        !send(process, "isready") ||
+        !wait_for(process, "readyok", handshake_timeout_ms, line)) {
+        stop(process);
+        return false;
+    }
+    return true;
+}
+
+void UciEnginePool::stop(Process &process) {
+    if (process.pid == -1) {
+        return;
+    }
+    close(process.input);
+    close(process.output);
+    kill(process.pid, SIGKILL);
+    waitpid(process.pid, nullptr, 0);
+    process.pid = -1;
+    process.input = -1;
+    process.output = -1;
+}
+
+bool UciEnginePool::send(Process &process, const std::string &command) {
+    std::string line = command + "\n";
+    size_t written = 0;
+    while (written < line.size()) {
+        ssize_t bytes = write(process.input, line.data() + written,
+                              line.size() - written);
+        if (bytes == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            return false;
+        }
+        written += bytes;
+    }
+    return true;
+}
+
+bool UciEnginePool::wait_for(Process &process, const std::string &prefix,
+                             int timeout_ms, std::string &line) {
+    int64_t deadline = now_ms() + timeout_ms;
+    while (true) {
+        size_t end;
+        while ((end = process.buffer.find('\n')) != std::string::npos) {
+            line = process.buffer.substr(0, end);
+            process.buffer.erase(0, end + 1);
+            if (line.compare(0, prefix.size(), prefix) == 0) {
+                return true;
+            }
+        }
+
+        int remaining = static_cast<int>(deadline - now_ms());
+        if (remaining <= 0) {
+            return false;
         }
+        pollfd fd{process.output, POLLIN, 0};
+        int ready = poll(&fd, 1, remaining);
+        if (ready == -1 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            return false;
+        }
+
+        char buffer[4096];
+        ssize_t bytes = read(process.output, buffer, sizeof(buffer));
+        if (bytes == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            // the engine exited
+            return false;
+        }
+        process.buffer.append(buffer, bytes);
     }
+}
 
-    std::string bestmove;
-    std::istringstream iss(result);
+std::string UciEnginePool::search(Process &process, const std::string &game,
+                                  const std::vector<std::string> &moves,
+                                  const UciLimits &limits) {
     std::string line;
-    while (std::getline(iss, line)) {
-        if (line.find("bestmove") != std::string::npos) {
-            size_t start = line.find("bestmove") + 9;
-            size_t end = line.find(' ', start);
-            bestmove = line.substr(start, end - start);
+    if (process.game != game) {
+        if (!send(process, "ucinewgame") || !send(process, "isready") ||
+            !wait_for(process, "readyok", handshake_timeout_ms, line)) {
+            return "";
+        }
+        process.game = game;
+    }
+
+    std::string position = "position startpos moves";
+    for (const auto &move : moves) {
+        position += " " + move;
+    }
+    std::string go = limits.movetime_ms > 0
+                         ? "go movetime " + std::to_string(limits.movetime_ms)
+                         : "go depth " + std::to_string(limits.depth);
+    if (!send(process, position) || !send(process, go)) {
+        return "";
+    }
+
+    if (!wait_for(process, "bestmove", limits.timeout_ms, line)) {
+        // ask for the best move so far, the caller restarts on failure
+        if (!send(process, "stop") ||
+            !wait_for(process, "bestmove", stop_grace_ms, line)) {
+            return "";
+        }
+    }
+
+    size_t start = line.find(' ');
+    if (start == std::string::npos) {
+        return "";
+    }
+    size_t end = line.find(' ', start + 1);
+    return line.substr(start + 1, end - start - 1);
+}
+
+std::string UciEnginePool::best_move(const std::string &game,
+                                     const std::vector<std::string> &moves,
+                                     const UciLimits &limits) {
+    std::unique_ptr<Process> process;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_ready_.wait(lock, [this]() { return !idle_.empty(); });
+        process = std::move(idle_.back());
+        idle_.pop_back();
+    }
+
+    std::string move;
+    // retry once on a fresh process if the engine died or hung
+    for (int attempt = 0; attempt < 2 && move.empty(); attempt++) {
+        if (process->pid == -1 && !start(*process)) {
             break;
         }
+        move = search(*process, game, moves, limits);
+        if (move.empty()) {
+            log_message(LogLevel::Warning, "restarting " + command_);
+            stop(*process);
+        }
     }
 
-    return bestmove;
-}
\ No newline at end of file
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_.push_back(std::move(process));
+    }
+    idle_ready_.notify_one();
+
+    if (move.empty()) {
+        throw std::runtime_error("failed to get a move from " + command_);
+    }
+    return move;
+}
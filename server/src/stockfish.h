@@ -1,6 +1,57 @@
 #pragma once
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <sys/types.h>
 #include <vector>
 
-std::string generate_move_stockfish(std::vector<std::string> &moves);
+struct UciLimits {
+    // search depth, used when movetime_ms is 0
+    int depth = 20;
+    int movetime_ms = 0;
+    // how long to wait for bestmove before stopping the engine
+    int timeout_ms = 30000;
+};
+
+// pool of long-lived UCI engine processes. each process is started and
+// handshaken once, requests are dispatched to idle processes and a process
+// that crashes or stops responding is restarted.
+class UciEnginePool {
+  public:
+    UciEnginePool(std::string command, int size);
+    ~UciEnginePool();
+
+    // best move for the position reached by playing moves from the starting
+    // position. game identifies the game so the engine is only told about a
+    // new game when it switches games. throws std::runtime_error on failure.
+    std::string best_move(const std::string &game,
+                          const std::vector<std::string> &moves,
+                          const UciLimits &limits);
+
+  private:
+    struct Process {
+        pid_t pid = -1;
+        int input = -1;
+        int output = -1;
+        std::string buffer;
+        std::string game;
+    };
+
+    // start the engine and run the uci/isready handshake
+    bool start(Process &process);
+    void stop(Process &process);
+    bool send(Process &process, const std::string &command);
+    // read lines until one starts with prefix, false on timeout or exit
+    bool wait_for(Process &process, const std::string &prefix, int timeout_ms,
+                  std::string &line);
+    std::string search(Process &process, const std::string &game,
+                       const std::vector<std::string> &moves,
+                       const UciLimits &limits);
+
+    std::string command_;
+    std::mutex mutex_;
+    std::condition_variable idle_ready_;
+    std::vector<std::unique_ptr<Process>> idle_;
+};